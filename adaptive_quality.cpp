@@ -0,0 +1,65 @@
+#include "adaptive_quality.hpp"
+#include <algorithm>
+
+namespace {
+
+using namespace gen;
+
+float median(std::vector<float>& vs) {
+  auto mid = vs.begin() + vs.size() / 2;
+  std::nth_element(vs.begin(), mid, vs.end());
+  return *mid;
+}
+
+} //  anon
+
+bool gen::AdaptiveQuality::push(
+  const UpdateSlimeMoldParticlesResult& res, const QualityLevel& current, QualityLevel* next) {
+  //
+  total_ms.push_back(res.dt_ms);
+  particle_ms.push_back(res.sort_ms + res.update_ms + res.deposit_ms);
+  map_ms.push_back(res.post_step_ms);
+  if (int(total_ms.size()) < std::max(1, window_frames)) {
+    return false;
+  }
+
+  const float total = median(total_ms);
+  const float particles = median(particle_ms);
+  const float map = median(map_ms);
+  const float other = std::max(0.0f, total - particles - map);
+  reset();
+
+  const int tex = current.texture_size;
+  const int n = current.num_particles;
+  *next = current;
+  if (total > target_ms * (1.0f + tolerance)) {
+    const bool can_shrink_map = tex / 2 >= min_texture_size;
+    const bool can_drop_particles = n > min_particles;
+    if (can_shrink_map && (map >= particles || !can_drop_particles)) {
+      next->texture_size = tex / 2;
+    } else if (can_drop_particles) {
+      next->num_particles = std::max(min_particles, int(float(n) / particle_step));
+    }
+  } else {
+    //  Predicted totals a step up; the larger map has 4x the texels.
+    const float up_to = target_ms * (1.0f - tolerance);
+    const int more_particles = std::min(max_particles, int(float(n) * particle_step));
+    const float map_up = tex * 2 <= max_texture_size ? other + particles + map * 4.0f : -1.0f;
+    const float particles_up = more_particles > n && n > 0 ?
+      other + map + particles * float(more_particles) / float(n) : -1.0f;
+    const bool map_fits = map_up >= 0.0f && map_up < up_to;
+    const bool particles_fit = particles_up >= 0.0f && particles_up < up_to;
+    if (map_fits && (!particles_fit || map_up <= particles_up)) {
+      next->texture_size = tex * 2;
+    } else if (particles_fit) {
+      next->num_particles = more_particles;
+    }
+  }
+  return next->texture_size != tex || next->num_particles != n;
+}
+
+void gen::AdaptiveQuality::reset() {
+  total_ms.clear();
+  particle_ms.clear();
+  map_ms.clear();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "slime_mold.hpp"
+#include <vector>
+
+namespace gen {
+
+struct QualityLevel {
+  int texture_size;
+  int num_particles;
+};
+
+/*
+ * Picks the texture size and particle count that hold the simulation's time per frame near
+ * `target_ms`, from the stage timings of the frames it is fed. Each window of `window_frames`
+ * frames is summarized by its medians. A window over `target_ms * (1 + tolerance)` steps down
+ * whichever knob the costlier stages scale with: the particle count for sort, update and
+ * deposit, the texture size for the post-deposit pass. A window that would stay under
+ * `target_ms * (1 - tolerance)` after a step up, taking costs to be linear in particles and
+ * texels, steps up whichever knob stays cheaper. Changes go one step at a time, and the window
+ * after one starts over, so the gap between the two thresholds keeps it from oscillating.
+ */
+class AdaptiveQuality {
+public:
+  //  Feeds one frame's timings at level `current`; true once a window calls for `*next`.
+  bool push(const UpdateSlimeMoldParticlesResult& res, const QualityLevel& current,
+            QualityLevel* next);
+  void reset();
+
+public:
+  float target_ms{8.0f};
+  float tolerance{0.2f};
+  int window_frames{60};
+  int min_texture_size{256};
+  int max_texture_size{1024};  //  sizes step by factors of 2
+  int min_particles{1000};
+  int max_particles{200000};
+  float particle_step{1.5f};
+
+private:
+  std::vector<float> total_ms;
+  std::vector<float> particle_ms;
+  std::vector<float> map_ms;
+};
+
+}
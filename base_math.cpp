@@ -28,4 +28,9 @@ float urandf() {
 
 float urand_11f() {
   return float(urand_11());
+}
+
+uint64_t random_seed() {
+  std::random_device rd;
+  return (uint64_t(rd()) << 32) | uint64_t(rd());
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <cstddef>
 #include <algorithm>
 #include <limits>
+#include <tuple>
 
 /*
  * Vec2
@@ -1036,4 +1037,88 @@ float urand_11f();
 template <typename T>
 T* uniform_array_sample(T* array, size_t size) {
   return size == 0 ? nullptr : array + size_t(double(size) * urand());
-}
\ No newline at end of file
+}
+
+//  A seed from std::random_device.
+uint64_t random_seed();
+
+/*
+ * Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC11). A
+ * counter-based generator: each output block is a pure function of a 128-bit counter and a 64-bit
+ * key, with no state carried between calls. Kernels derive the counter from what they are working
+ * on (a particle, a row, a step), so they get the same numbers on any thread, in any order, and
+ * per vector lane or per scalar iteration alike.
+ */
+inline void philox4x32_10(const uint32_t ctr[4], uint64_t key, uint32_t out[4]) {
+  constexpr uint32_t m0 = 0xd2511f53u;
+  constexpr uint32_t m1 = 0xcd9e8d57u;
+  constexpr uint32_t w0 = 0x9e3779b9u;
+  constexpr uint32_t w1 = 0xbb67ae85u;
+
+  uint32_t c0 = ctr[0];
+  uint32_t c1 = ctr[1];
+  uint32_t c2 = ctr[2];
+  uint32_t c3 = ctr[3];
+  uint32_t k0 = uint32_t(key);
+  uint32_t k1 = uint32_t(key >> 32);
+  for (int r = 0; r < 10; r++) {
+    const uint64_t p0 = uint64_t(m0) * c0;
+    const uint64_t p1 = uint64_t(m1) * c2;
+    c0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+    c1 = uint32_t(p1);
+    c2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+    c3 = uint32_t(p0);
+    k0 += w0;
+    k1 += w1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+//  [0, 1), from the top 24 bits.
+inline float u32_to_unit_float(uint32_t v) {
+  return float(v >> 8) * 0x1p-24f;
+}
+
+/*
+ * Sequential draws from the Philox stream named by (stream, index, sequence) under key `seed`.
+ * Counter word 0 advances with every block of 4 draws; the other three words name the stream,
+ * e.g. a kind of draw, a particle index and a step number.
+ */
+class CounterRng {
+public:
+  CounterRng(uint64_t seed, uint32_t stream, uint32_t index, uint32_t sequence = 0) :
+    key{seed}, ctr{0, index, sequence, stream} {
+    //
+  }
+
+  uint32_t next_u32() {
+    if (next == 4) {
+      philox4x32_10(ctr, key, block);
+      ctr[0]++;
+      next = 0;
+    }
+    return block[next++];
+  }
+
+  float urandf() {
+    return u32_to_unit_float(next_u32());
+  }
+
+  float urand_11f() {
+    return urandf() * 2.0f - 1.0f;
+  }
+
+  //  [0, n)
+  int uniform_int(int n) {
+    return std::min(n - 1, int(urandf() * float(n)));
+  }
+
+private:
+  uint64_t key;
+  uint32_t ctr[4];
+  uint32_t block[4]{};
+  int next{4};
+};
\ No newline at end of file
@@ -0,0 +1,446 @@
+#include "slime_mold.hpp"
+#include "slime_mold_kernels.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Benchmarks the simulation stages one at a time (see slime_mold_kernels.hpp), swept over map
+ * sizes, particle counts and filter sizes. Each measurement warms up, then takes samples until it
+ * has both `min_samples` and `min_time_s` worth of them, and reports the median and the median
+ * absolute deviation along with throughput. Results go to stdout as a table and, optionally, to a
+ * JSON file.
+ *
+ * Byte counts are a model of the memory each stage must move, not measured traffic:
+ *  - particle stages count the particle arrays they stream plus the map texels they touch;
+ *  - map stages count each map they read or write once, at 16 bytes per RGBX float texel.
+ */
+
+namespace {
+
+using namespace gen;
+using Clock = std::chrono::high_resolution_clock;
+
+constexpr int texel_bytes = 16;
+//  Particle array bytes read and written per particle by `update_particles`: position, heading,
+//  sensor directions, sensor step and size, channel weights, speed terms, turn rotation and the
+//  right-only flag are read, and position and heading are written back.
+constexpr int update_particle_bytes = 8 + 8 + 16 + 8 + 12 + 12 + 8 + 1 + 16;
+//  Position, deposit and channel weights read, plus a texel read and written.
+constexpr int deposit_particle_bytes = 8 + 4 + 12 + 2 * 12;
+
+volatile float sink;
+
+//  Stores `v` where the compiler has to assume it is read, so the work behind it stays.
+void do_not_optimize(float v) {
+  sink = v;
+}
+
+struct BenchOptions {
+  std::vector<int> dims{256, 512, 1024, 2048, 4096};
+  std::vector<int> particle_counts{1000, 10000, 100000, 1000000, 10000000};
+  std::vector<int> filter_sizes{3, 5, 9, 17};
+  std::vector<std::string> kernels;  //  empty: all
+  int threads{1};
+  double min_time_s{0.25};
+  int min_samples{5};
+  int max_samples{200};
+  std::string json_path;
+};
+
+struct Stats {
+  int samples;
+  double median_ms;
+  double mad_ms;
+  double min_ms;
+  double mean_ms;
+};
+
+struct Result {
+  std::string kernel;
+  int dim;
+  int particles;  //  0 for map stages
+  int filter_size;  //  0 where it does not apply
+  Stats stats;
+  double items;  //  particles or texels processed per run
+  double bytes;
+};
+
+double median_of(std::vector<double> vs) {
+  std::sort(vs.begin(), vs.end());
+  const size_t n = vs.size();
+  return n % 2 == 1 ? vs[n / 2] : 0.5 * (vs[n / 2 - 1] + vs[n / 2]);
+}
+
+//  `reset` runs before every run, outside the timed region, e.g. to restore the run's input.
+template <typename F, typename R>
+Stats measure(const BenchOptions& opts, F&& run, R&& reset) {
+  //  Warm caches and lazily-built state for about a tenth of the budget.
+  const auto warm0 = Clock::now();
+  do {
+    reset();
+    run();
+  } while (std::chrono::duration<double>(Clock::now() - warm0).count() < opts.min_time_s * 0.1);
+
+  std::vector<double> ms;
+  double elapsed_s{};
+  while (int(ms.size()) < opts.max_samples &&
+         (int(ms.size()) < opts.min_samples || elapsed_s < opts.min_time_s)) {
+    reset();
+    const auto t0 = Clock::now();
+    run();
+    const double s = std::chrono::duration<double>(Clock::now() - t0).count();
+    ms.push_back(s * 1e3);
+    elapsed_s += s;
+  }
+
+  Stats res{};
+  res.samples = int(ms.size());
+  res.median_ms = median_of(ms);
+  res.min_ms = *std::min_element(ms.begin(), ms.end());
+  for (double v : ms) {
+    res.mean_ms += v / double(ms.size());
+  }
+  std::vector<double> dev(ms.size());
+  for (size_t i = 0; i < ms.size(); i++) {
+    dev[i] = std::abs(ms[i] - res.median_ms);
+  }
+  res.mad_ms = median_of(std::move(dev));
+  return res;
+}
+
+template <typename F>
+Stats measure(const BenchOptions& opts, F&& run) {
+  return measure(opts, std::forward<F>(run), []() {});
+}
+
+bool selected(const BenchOptions& opts, const char* kernel) {
+  return opts.kernels.empty() ||
+         std::find(opts.kernels.begin(), opts.kernels.end(), kernel) != opts.kernels.end();
+}
+
+std::unique_ptr<float[]> make_random_map(int dim, uint32_t stream) {
+  auto res = std::make_unique<float[]>(size_t(dim) * dim * 4);
+  for (int y = 0; y < dim; y++) {
+    CounterRng rng(1, stream, uint32_t(y));
+    float* row = res.get() + size_t(y) * dim * 4;
+    for (int x = 0; x < dim; x++) {
+      row[x * 4 + 0] = rng.urandf();
+      row[x * 4 + 1] = rng.urandf();
+      row[x * 4 + 2] = rng.urandf();
+    }
+  }
+  return res;
+}
+
+//  Uniformly spread, unlike the clustered start of a simulation, so timings do not drift as
+//  particles disperse.
+SlimeParticles make_spread_particles(const SlimeMoldConfig& config) {
+  auto res = make_slime_mold_particles(config);
+  for (int i = 0; i < res.size(); i++) {
+    CounterRng rng(config.seed, 0, uint32_t(i));
+    res.position_x[i] = rng.urandf();
+    res.position_y[i] = rng.urandf();
+  }
+  return res;
+}
+
+//  Texels covered by a sensing window of `win_size`, for the byte model.
+double window_texels(float win_size, int dim) {
+  const double side = std::floor(double(win_size) * dim) + 1.0;
+  return side * side;
+}
+
+class Runner {
+public:
+  explicit Runner(const BenchOptions& opts) : opts{opts} {
+    if (opts.threads != 1) {
+      pool.set_num_threads(opts.threads);
+    }
+  }
+
+  void run() {
+    for (int dim : opts.dims) {
+      run_map_stages(dim);
+      for (int n : opts.particle_counts) {
+        run_particle_stages(dim, n);
+      }
+    }
+  }
+
+  const std::vector<Result>& get_results() const {
+    return results;
+  }
+
+private:
+  ThreadPool* pool_or_null() {
+    return opts.threads != 1 ? &pool : nullptr;
+  }
+
+  void add(Result res) {
+    const double s = res.stats.median_ms * 1e-3;
+    std::printf(
+      "%-16s dim %5d  particles %9d  k %2d  %10.3f ms (+/- %5.1f%%, n=%3d)  %9.3g items/s  %7.2f GB/s\n",
+      res.kernel.c_str(), res.dim, res.particles, res.filter_size, res.stats.median_ms,
+      res.stats.median_ms > 0.0 ? 100.0 * res.stats.mad_ms / res.stats.median_ms : 0.0,
+      res.stats.samples, s > 0.0 ? res.items / s : 0.0, s > 0.0 ? res.bytes / s * 1e-9 : 0.0);
+    std::fflush(stdout);
+    results.push_back(std::move(res));
+  }
+
+  void run_map_stages(int dim) {
+    const double texels = double(dim) * dim;
+    const double map_bytes = texels * texel_bytes;
+    auto map_data = make_random_map(dim, 1);
+    const auto initial_data = make_random_map(dim, 1);
+    const float* initial = initial_data.get();
+    auto other = make_random_map(dim, 2);
+    auto tmp = std::make_unique<float[]>(size_t(texels) * 4);
+    auto rgbau8 = std::make_unique<uint8_t[]>(size_t(texels) * 4);
+    const MapView<float> map{map_data.get(), dim, dim};
+
+    for (int k : opts.filter_sizes) {
+      if (selected(opts, "box_filter")) {
+        auto stats = measure(opts, [&]() {
+          kernels::box_filter(map, map, {tmp.get(), dim, dim}, k);
+        });
+        //  source, tmp written and read, destination
+        add({"box_filter", dim, 0, k, stats, texels, 4.0 * map_bytes});
+      }
+      //  Lerp and decay are applied to each blurred row as it leaves the filter, so they only run
+      //  with it and are timed as part of "diffuse".
+      if (selected(opts, "diffuse")) {
+        kernels::PostStepStages stages{};
+        stages.diffuse = true;
+        stages.filter_size = k;
+        stages.diffuse_speed = SlimeMoldConfig::default_diffuse_speed;
+        stages.decay = SlimeMoldConfig::default_decay;
+        add(post_step_result("diffuse", dim, k, stages, map, initial, 2.0 * map_bytes));
+      }
+    }
+
+    kernels::PostStepStages stages{};
+    if (selected(opts, "signal")) {
+      stages.signal = other.get();
+      add(post_step_result("signal", dim, 0, stages, map, initial, 3.0 * map_bytes));
+      stages.signal = nullptr;
+    }
+    if (selected(opts, "perturb")) {
+      stages.perturb = other.get();
+      add(post_step_result("perturb", dim, 0, stages, map, initial, 3.0 * map_bytes));
+      stages.perturb = nullptr;
+    }
+    if (selected(opts, "average")) {
+      stages.average = true;
+      add(post_step_result("average", dim, 0, stages, map, initial, 2.0 * map_bytes));
+      stages.average = false;
+    }
+    if (selected(opts, "pack")) {
+      stages.rgbau8 = rgbau8.get();
+      add(post_step_result("pack", dim, 0, stages, map, initial, 2.0 * map_bytes + texels * 4));
+      stages.rgbau8 = nullptr;
+    }
+  }
+
+  //  Decay drains the map run after run, so each run starts over from `initial`.
+  Result post_step_result(
+    const char* name, int dim, int k, const kernels::PostStepStages& stages,
+    MapView<float> map, const float* initial, double bytes) {
+    //
+    auto stats = measure(
+      opts,
+      [&]() {
+        kernels::post_step(stages, map, pool_or_null(), ws);
+      },
+      [&]() {
+        std::copy(initial, initial + map.size(), map.data);
+      });
+    return {name, dim, 0, k, stats, double(dim) * dim, bytes};
+  }
+
+  void run_particle_stages(int dim, int num_particles) {
+    const bool any = selected(opts, "update") || selected(opts, "sense") ||
+                     selected(opts, "sense_circular") || selected(opts, "deposit");
+    if (!any) {
+      return;
+    }
+
+    SlimeMoldConfig config{};
+    config.num_particles = num_particles;
+    config.num_threads = opts.threads;
+    auto parts = make_spread_particles(config);
+    auto map_data = make_random_map(dim, 1);
+    const MapView<float> map{map_data.get(), dim, dim};
+    const float win_size = parts.sensor_size[0];
+    const double sensed_bytes = window_texels(win_size, dim) * 12.0;
+
+    if (selected(opts, "update")) {
+      auto stats = measure(opts, [&]() {
+        kernels::update_particles(config, parts, map, pool_or_null());
+      });
+      const double bytes = num_particles * (update_particle_bytes + 3.0 * sensed_bytes);
+      add({"update", dim, num_particles, 0, stats, double(num_particles), bytes});
+    }
+
+    auto sense_stage = [&](const char* name, auto&& sense) {
+      auto stats = measure(opts, [&]() {
+        Vec3f sum{};
+        for (int i = 0; i < num_particles; i++) {
+          sum += sense(map, Vec2f{parts.position_x[i], parts.position_y[i]}, win_size);
+        }
+        do_not_optimize(sum.x + sum.y + sum.z);
+      });
+      const double bytes = num_particles * (8.0 + sensed_bytes);
+      add({name, dim, num_particles, 0, stats, double(num_particles), bytes});
+    };
+    if (selected(opts, "sense")) {
+      sense_stage("sense", kernels::sense);
+    }
+    if (selected(opts, "sense_circular")) {
+      sense_stage("sense_circular", kernels::sense_circular);
+    }
+
+    if (selected(opts, "deposit")) {
+      auto stats = measure(opts, [&]() {
+        kernels::deposit_particles(parts, map, pool_or_null(), ws);
+      });
+      const double bytes = double(num_particles) * deposit_particle_bytes;
+      add({"deposit", dim, num_particles, 0, stats, double(num_particles), bytes});
+    }
+  }
+
+private:
+  const BenchOptions& opts;
+  ThreadPool pool;
+  SlimeMoldSimulationWorkspace ws;
+  std::vector<Result> results;
+};
+
+bool write_json(const std::string& path, const BenchOptions& opts, const std::vector<Result>& rs) {
+  FILE* f = std::fopen(path.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+  std::fprintf(f, "{\n  \"threads\": %d,\n  \"results\": [\n", opts.threads);
+  for (size_t i = 0; i < rs.size(); i++) {
+    const auto& r = rs[i];
+    const double s = r.stats.median_ms * 1e-3;
+    std::fprintf(
+      f,
+      "    {\"kernel\": \"%s\", \"dim\": %d, \"particles\": %d, \"filter_size\": %d, "
+      "\"samples\": %d, \"median_ms\": %.6f, \"mad_ms\": %.6f, \"min_ms\": %.6f, "
+      "\"mean_ms\": %.6f, \"items_per_s\": %.6g, \"gb_per_s\": %.6g}%s\n",
+      r.kernel.c_str(), r.dim, r.particles, r.filter_size, r.stats.samples, r.stats.median_ms,
+      r.stats.mad_ms, r.stats.min_ms, r.stats.mean_ms, s > 0.0 ? r.items / s : 0.0,
+      s > 0.0 ? r.bytes / s * 1e-9 : 0.0, i + 1 < rs.size() ? "," : "");
+  }
+  std::fprintf(f, "  ]\n}\n");
+  return std::fclose(f) == 0;
+}
+
+std::vector<int> parse_int_list(const char* s) {
+  std::vector<int> res;
+  while (*s) {
+    char* end{};
+    res.push_back(int(std::strtol(s, &end, 10)));
+    s = *end == ',' ? end + 1 : end;
+    if (end == s && *s) {
+      return {};
+    }
+  }
+  return res;
+}
+
+std::vector<std::string> parse_string_list(const char* s) {
+  std::vector<std::string> res;
+  std::string curr;
+  for (; *s; s++) {
+    if (*s == ',') {
+      res.push_back(curr);
+      curr.clear();
+    } else {
+      curr += *s;
+    }
+  }
+  if (!curr.empty()) {
+    res.push_back(curr);
+  }
+  return res;
+}
+
+void print_usage(const char* exe) {
+  std::fprintf(
+    stderr,
+    "usage: %s [options]\n"
+    "  --dims A,B,...        map sizes (256,512,1024,2048,4096)\n"
+    "  --particles A,B,...   particle counts (1000,...,10000000)\n"
+    "  --filter-sizes A,...  box filter sizes (3,5,9,17)\n"
+    "  --kernels A,B,...     only these of: update, sense, sense_circular, deposit, box_filter,\n"
+    "                        diffuse, signal, perturb, average, pack\n"
+    "  --threads N           worker threads; 1 runs on the calling thread only (1)\n"
+    "  --min-time S          minimum sampled seconds per measurement (0.25)\n"
+    "  --min-samples N       minimum samples per measurement (5)\n"
+    "  --json PATH           also write results as JSON\n",
+    exe);
+}
+
+bool parse_options(int argc, char** argv, BenchOptions* opts) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* v = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!v) {
+      return false;
+    }
+    i++;
+    if (std::strcmp(arg, "--dims") == 0) {
+      opts->dims = parse_int_list(v);
+    } else if (std::strcmp(arg, "--particles") == 0) {
+      opts->particle_counts = parse_int_list(v);
+    } else if (std::strcmp(arg, "--filter-sizes") == 0) {
+      opts->filter_sizes = parse_int_list(v);
+    } else if (std::strcmp(arg, "--kernels") == 0) {
+      opts->kernels = parse_string_list(v);
+    } else if (std::strcmp(arg, "--threads") == 0) {
+      opts->threads = std::atoi(v);
+    } else if (std::strcmp(arg, "--min-time") == 0) {
+      opts->min_time_s = std::atof(v);
+    } else if (std::strcmp(arg, "--min-samples") == 0) {
+      opts->min_samples = std::max(1, std::atoi(v));
+    } else if (std::strcmp(arg, "--json") == 0) {
+      opts->json_path = v;
+    } else {
+      return false;
+    }
+  }
+  auto positive = [](const std::vector<int>& vs) {
+    return !vs.empty() && std::all_of(vs.begin(), vs.end(), [](int v) { return v > 0; });
+  };
+  return positive(opts->dims) && positive(opts->particle_counts) &&
+         positive(opts->filter_sizes);
+}
+
+} //  anon
+
+int main(int argc, char** argv) {
+  BenchOptions opts;
+  if (!parse_options(argc, argv, &opts)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  Runner runner{opts};
+  runner.run();
+
+  if (!opts.json_path.empty() && !write_json(opts.json_path, opts, runner.get_results())) {
+    std::fprintf(stderr, "failed to write %s\n", opts.json_path.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -2,6 +2,8 @@
 #include "slime_mold_component.hpp"
 #include "slime_mold.hpp"
 #include <imgui.h>
+#include <algorithm>
+#include <cstdio>
 
 #ifdef SM_IS_EMSCRIPTEN
 #include <emscripten.h>
@@ -243,6 +245,56 @@ WebGUIResult web_gui_update() {
 
 #endif
 
+namespace {
+
+void render_telemetry(gen::SimTelemetry& telemetry) {
+  int window_size = telemetry.window_size();
+  if (ImGui::InputInt("Window", &window_size, 60, 600) && window_size > 0) {
+    telemetry.set_window_size(window_size);
+  }
+
+  gen::SimStageSummary summaries[gen::num_sim_stages];
+  for (int i = 0; i < gen::num_sim_stages; i++) {
+    summaries[i] = telemetry.summarize(gen::SimStage(i));
+  }
+
+  ImGui::Text("%d frames (ms)", telemetry.size());
+  const auto table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg;
+  if (ImGui::BeginTable("StageTimes", 6, table_flags)) {
+    const char* const cols[6]{"stage", "last", "p50", "p95", "p99", "max"};
+    for (auto* col : cols) {
+      ImGui::TableSetupColumn(col);
+    }
+    ImGui::TableHeadersRow();
+    for (int i = 0; i < gen::num_sim_stages; i++) {
+      const auto& s = summaries[i];
+      const float vs[5]{s.last, s.p50, s.p95, s.p99, s.max};
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(gen::to_string(gen::SimStage(i)));
+      for (float v : vs) {
+        ImGui::TableNextColumn();
+        ImGui::Text("%.3f", v);
+      }
+    }
+    ImGui::EndTable();
+  }
+
+  if (ImGui::TreeNode("Plots")) {
+    for (int i = 0; i < gen::num_sim_stages; i++) {
+      const auto& s = summaries[i];
+      char overlay[64];
+      std::snprintf(overlay, sizeof(overlay), "p99 %.3f  max %.3f", s.p99, s.max);
+      ImGui::PlotLines(
+        gen::to_string(gen::SimStage(i)), telemetry.samples(gen::SimStage(i)), telemetry.size(),
+        telemetry.offset(), overlay, 0.0f, std::max(s.max, 1e-3f), ImVec2(0.0f, 40.0f));
+    }
+    ImGui::TreePop();
+  }
+}
+
+} //  anon
+
 void init_gui() {
 #ifdef SM_IS_EMSCRIPTEN
   web_gui_init();
@@ -251,27 +303,21 @@ void init_gui() {
 
 GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& params) {
   float fps = params.app_fps;
-  float sim_t = params.sim_t;
   bool* use_bw = params.use_bw;
   bool* full_screen = params.full_screen;
 
-  static uint32_t update_index{};
-  static float last_sim_t{};
 #ifdef SM_IS_EMSCRIPTEN
   static bool debug_gui_enabled{false};
 #else
   static bool debug_gui_enabled{true};
 #endif
 
-  if ((++update_index % 30) == 0) {
-    last_sim_t = sim_t;
-  }
-
   GUIUpdateResult result;
 
   bool high_res{};
   bool med_res{};
   bool low_res{};
+  bool auto_res{};
 
   bool mid_coh{};
   bool high_coh{};
@@ -279,7 +325,7 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
   bool fragile{};
   bool clustered{};
   bool slow_preset{};
-  const bool is_high_res = gen::SlimeMoldConfig::texture_dim > 512;
+  const bool is_high_res = component.get_texture_dim() > 512;
 
   const float min_time_scale = 0.01f;
   const float max_time_scale = 8.0f;
@@ -289,6 +335,7 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
   high_res = web_gui_res.quality_preset == "high";
   med_res = web_gui_res.quality_preset == "med";
   low_res = web_gui_res.quality_preset == "low";
+  auto_res = web_gui_res.quality_preset == "auto";
 
   mid_coh = web_gui_res.style_preset == "mid_coh";
   high_coh = web_gui_res.style_preset == "high_coh";
@@ -343,9 +390,22 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
       result.enabled = enabled;
     }
 
+    bool sim_thread = component.sim_thread_running();
+    if (ImGui::Checkbox("SimThread", &sim_thread)) {
+      result.sim_thread = sim_thread;
+    }
+
     if (ImGui::Button("Reinitialize")) {
       result.reinitialize = true;
     }
+    ImGui::SameLine();
+    if (ImGui::Button("SaveState")) {
+      result.save_checkpoint_path = "slime_mold.ckpt";
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("LoadState")) {
+      result.load_checkpoint_path = "slime_mold.ckpt";
+    }
 
     high_res = high_res | ImGui::Button("HighRes");
     ImGui::SameLine();
@@ -353,6 +413,20 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
     ImGui::SameLine();
     low_res = low_res | ImGui::Button("LowRes");
 
+    bool adaptive_quality = component.params.adaptive_quality;
+    if (ImGui::Checkbox("AdaptiveQuality", &adaptive_quality)) {
+      result.adaptive_quality = adaptive_quality;
+    }
+    if (adaptive_quality) {
+      float target_ms = component.sim.quality.target_ms;
+      if (ImGui::SliderFloat("TargetSimMs", &target_ms, 1.0f, 33.0f)) {
+        result.quality_target_ms = target_ms;
+      }
+      ImGui::Text(
+        "%dx%d, %d particles", component.get_texture_dim(), component.get_texture_dim(),
+        component.get_current_num_particles());
+    }
+
     if (ImGui::TreeNode("Presets")) {
       mid_coh = mid_coh | ImGui::SmallButton("MidCoherence");
       high_coh = high_coh | ImGui::SmallButton("HighCoherence");
@@ -380,7 +454,6 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
       ImGui::TreePop();
     }
 
-#if DYNAMIC_TEXTURE_SIZE
     if (ImGui::TreeNode("ImageSize")) {
       static int item{};
       static constexpr int num_items = 3;
@@ -397,7 +470,24 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
       }
       ImGui::TreePop();
     }
-#endif
+
+    if (ImGui::TreeNode("MapStorage")) {
+      static int item{};
+      static constexpr int num_items = 3;
+      const char* const items_str[num_items]{"float32", "float16", "unorm16"};
+      const IntegralType items[num_items]{
+        IntegralType::Float, IntegralType::HalfFloat, IntegralType::UnsignedShort};
+      for (int i = 0; i < num_items; i++) {
+        if (items[i] == component.sim.config.map_storage_type) {
+          item = i;
+          break;
+        }
+      }
+      if (ImGui::ListBox("", &item, items_str, num_items)) {
+        result.new_map_storage_type = items[item];
+      }
+      ImGui::TreePop();
+    }
 
     const auto& soil_config = component.sim.config;
 
@@ -413,6 +503,22 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
       if (ImGui::SliderFloat("TimeScale", &ts, min_time_scale, max_time_scale)) {
         result.time_scale = ts;
       }
+      const auto& sim = component.sim;
+      bool fixed_timestep = sim.fixed_timestep;
+      if (ImGui::Checkbox("FixedTimestep", &fixed_timestep)) {
+        result.fixed_timestep = fixed_timestep;
+      }
+      if (sim.fixed_timestep) {
+        float budget_ms = sim.substepper.budget_ms;
+        if (ImGui::SliderFloat("StepBudgetMs", &budget_ms, 1.0f, 33.0f)) {
+          result.substep_budget_ms = budget_ms;
+        }
+        int max_substeps = sim.substepper.max_substeps;
+        if (ImGui::SliderInt("MaxSubsteps", &max_substeps, 1, 32)) {
+          result.max_substeps = max_substeps;
+        }
+        ImGui::Text("Substeps %d", sim.last_num_substeps);
+      }
       ImGui::TreePop();
     }
 
@@ -480,6 +586,11 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
       result.average_image = avg_img;
     }
 
+    bool sat_sensing = soil_config.summed_area_sensing;
+    if (ImGui::Checkbox("SummedAreaSensing", &sat_sensing)) {
+      result.summed_area_sensing = sat_sensing;
+    }
+
     if (ImGui::TreeNode("DirectionInfluence")) {
       if (ImGui::Button("Ex. 1")) {
         result.overlay_text = "Warping, or warped; tugging bits of self by lines, anchors set down shallow.";
@@ -532,6 +643,15 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
       ImGui::TreePop();
     }
 
+    if (ImGui::TreeNode("Telemetry")) {
+      bool stage_timing = soil_config.post_step_stage_timing;
+      if (ImGui::Checkbox("PostStepStageTiming", &stage_timing)) {
+        result.post_step_stage_timing = stage_timing;
+      }
+      render_telemetry(component.sim.telemetry);
+      ImGui::TreePop();
+    }
+
     if (ImGui::TreeNode("Render")) {
       ImGui::Checkbox("RenderB&W", use_bw);
       ImGui::Checkbox("RenderFullScreen", full_screen);
@@ -539,10 +659,17 @@ GUIUpdateResult render_gui(SlimeMoldComponent& component, const GUIParams& param
     }
 
     ImGui::Text("%.3f ms/frame (%.1f FPS)", 1e3f / fps, fps);
-    ImGui::Text("%.3f ms/sim step", last_sim_t);
+    const auto sim_t = component.sim.telemetry.summarize(gen::SimStage::Total);
+    ImGui::Text("%.3f ms/frame of sim (p50), %.3f (p99)", sim_t.p50, sim_t.p99);
     ImGui::End();
   } //  debug_gui_enabled;
 
+  if (high_res || med_res || low_res) {
+    result.adaptive_quality = false;
+  }
+  if (auto_res) {
+    result.adaptive_quality = true;
+  }
   if (high_res) {
     result.new_texture_size = 1024;
     result.new_num_particles = 25000;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "util.hpp"
 #include <optional>
 #include <string>
 
@@ -7,6 +8,7 @@ class SlimeMoldComponent;
 
 struct GUIUpdateResult {
   std::optional<bool> enabled;
+  std::optional<bool> sim_thread;
   std::optional<bool> parameter_capture_enabled;
   std::optional<bool> lock_parameter_targets;
   std::optional<bool> draw_texture;
@@ -16,16 +18,26 @@ struct GUIUpdateResult {
   std::optional<float> diffuse_speed;
   std::optional<bool> diffuse_enabled;
   std::optional<bool> average_image;
+  std::optional<bool> summed_area_sensing;
+  std::optional<bool> post_step_stage_timing;
   std::optional<bool> allow_perturb_event;
   std::optional<float> time_scale;
+  std::optional<bool> fixed_timestep;
+  std::optional<float> substep_budget_ms;
+  std::optional<int> max_substeps;
   std::optional<bool> circular_world;
   std::optional<bool> only_right_turns;
   std::optional<int> turn_speed_power;
   std::optional<int> speed_power;
   std::optional<bool> reinitialize;
+  std::optional<std::string> save_checkpoint_path;
+  std::optional<std::string> load_checkpoint_path;
   std::optional<bool> reset_diffuse_parameters;
   std::optional<int> new_num_particles;
+  std::optional<bool> adaptive_quality;
+  std::optional<float> quality_target_ms;
   std::optional<int> new_texture_size;
+  std::optional<IntegralType> new_map_storage_type;
   std::optional<std::string> direction_influencing_image_path;
   std::optional<std::string> overlay_text;
   std::optional<float> direction_influencing_image_scale;
@@ -34,7 +46,6 @@ struct GUIUpdateResult {
 
 struct GUIParams {
   float app_fps;
-  float sim_t;
   bool* use_bw;
   bool* full_screen;
   float* dir_image_mix;
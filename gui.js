@@ -51,7 +51,7 @@ let debug_gui_enabled = false;
 const qual_row = document.createElement('div');
 qual_row.style.width = '100%';
 div.appendChild(qual_row);
-(["low", "med", "high"]).map(p => {
+(["low", "med", "high", "auto"]).map(p => {
   const button1 = document.createElement('button');
   button1.innerText = p;
   button1.onclick = e => instance.set_quality_preset(p);
@@ -0,0 +1,441 @@
+#include "slime_mold.hpp"
+#include "slime_mold_checkpoint.hpp"
+#include "slime_mold_ensemble.hpp"
+#include "slime_mold_tiled.hpp"
+#include "slime_mold_shm.hpp"
+#include "slime_mold_telemetry.hpp"
+#include "thread_pool.hpp"
+#include "image_manip.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Runs the simulation without a window: N steps of `gen::update_slime_mold_particles` with a
+ * config given on the command line, optionally writing the RGBA8 map to PNG every K steps, then
+ * prints per-stage timing percentiles. With --ensemble, runs that many copies with consecutive
+ * seeds as one SlimeMoldEnsemble and prints the aggregate throughput instead. With --tiled, steps
+ * the map as tiles with a TiledSlimeMold; with --processes, as bands in that many forked processes
+ * sharing memory (SlimeMoldBandProcess). A single simulation can start from a checkpoint and
+ * save one when done.
+ */
+
+namespace {
+
+struct Options {
+  gen::SlimeMoldConfig config;
+  int steps{600};
+  int texture_width{DEFAULT_TEXTURE_SIZE};
+  int texture_height{DEFAULT_TEXTURE_SIZE};
+  int frame_interval{};  //  <= 0: no frames
+  int ensemble_size{};  //  <= 0: a single simulation
+  int tile_size{-1};  //  < 0: not tiled; 0: TiledSlimeMold picks the size
+  int num_processes{};  //  <= 0: this process only
+  std::string out_dir{"."};
+  std::string load_path;  //  empty: start from scratch
+  std::string save_path;  //  empty: do not save
+  bool compress_checkpoint{true};
+};
+
+void print_usage(const char* exe) {
+  std::fprintf(
+    stderr,
+    "usage: %s [options]\n"
+    "  --steps N           number of steps (600)\n"
+    "  --particles N       number of particles\n"
+    "  --size W[xH]        map width and height in texels (%d)\n"
+    "  --threads N         worker threads; <= 0: one per hardware thread\n"
+    "  --seed N            random seed (0)\n"
+    "  --storage TYPE      map storage: float, half or unorm16 (float)\n"
+    "  --sat               sense through a summed-area table\n"
+    "  --sort N            reorder particles spatially every N steps\n"
+    "  --no-simd           use the scalar particle update\n"
+    "  --no-wrap           clamp particles to the map instead of wrapping around\n"
+    "  --no-active-tiles   diffuse and pack the whole map, even where it is zero\n"
+    "  --frames N          write a PNG every N steps\n"
+    "  --ensemble K        run K simulations with seeds seed, seed + 1, ... together\n"
+    "  --tiled N           step the map as N x N tiles; 0 picks a size from the halo\n"
+    "  --processes P       step the map as P bands in P processes sharing memory\n"
+    "  --out DIR           directory for frames (.)\n"
+    "  --load FILE         resume from a checkpoint; its config replaces all but --threads\n"
+    "  --save FILE         write a checkpoint after the last step\n"
+    "  --no-compress       store checkpoint sections uncompressed\n",
+    exe, DEFAULT_TEXTURE_SIZE);
+}
+
+bool parse_storage(const char* s, IntegralType* type) {
+  if (std::strcmp(s, "float") == 0) {
+    *type = IntegralType::Float;
+  } else if (std::strcmp(s, "half") == 0) {
+    *type = IntegralType::HalfFloat;
+  } else if (std::strcmp(s, "unorm16") == 0) {
+    *type = IntegralType::UnsignedShort;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+//  "W" or "WxH"
+bool parse_size(const char* s, int* w, int* h) {
+  char* end{};
+  *w = int(std::strtol(s, &end, 10));
+  *h = *w;
+  if (*end == 'x') {
+    *h = int(std::strtol(end + 1, &end, 10));
+  }
+  return *end == '\0' && *w > 0 && *h > 0;
+}
+
+bool parse_options(int argc, char** argv, Options* opts) {
+  auto& config = opts->config;
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    auto value = [&]() -> const char* {
+      return i + 1 < argc ? argv[++i] : nullptr;
+    };
+    auto int_value = [&](int* dst) {
+      const char* v = value();
+      if (v) {
+        *dst = std::atoi(v);
+      }
+      return v != nullptr;
+    };
+
+    bool ok = true;
+    if (std::strcmp(arg, "--steps") == 0) {
+      ok = int_value(&opts->steps);
+    } else if (std::strcmp(arg, "--particles") == 0) {
+      ok = int_value(&config.num_particles);
+    } else if (std::strcmp(arg, "--size") == 0) {
+      const char* v = value();
+      ok = v && parse_size(v, &opts->texture_width, &opts->texture_height);
+    } else if (std::strcmp(arg, "--threads") == 0) {
+      ok = int_value(&config.num_threads);
+    } else if (std::strcmp(arg, "--seed") == 0) {
+      const char* v = value();
+      ok = v != nullptr;
+      if (ok) {
+        config.seed = std::strtoull(v, nullptr, 10);
+      }
+    } else if (std::strcmp(arg, "--storage") == 0) {
+      const char* v = value();
+      ok = v && parse_storage(v, &config.map_storage_type);
+    } else if (std::strcmp(arg, "--sat") == 0) {
+      config.summed_area_sensing = true;
+    } else if (std::strcmp(arg, "--sort") == 0) {
+      ok = int_value(&config.spatial_sort_interval);
+    } else if (std::strcmp(arg, "--no-simd") == 0) {
+      config.simd_update_enabled = false;
+    } else if (std::strcmp(arg, "--no-wrap") == 0) {
+      config.circular_world = false;
+    } else if (std::strcmp(arg, "--no-active-tiles") == 0) {
+      config.active_tile_tracking = false;
+    } else if (std::strcmp(arg, "--frames") == 0) {
+      ok = int_value(&opts->frame_interval);
+    } else if (std::strcmp(arg, "--ensemble") == 0) {
+      ok = int_value(&opts->ensemble_size);
+    } else if (std::strcmp(arg, "--tiled") == 0) {
+      ok = int_value(&opts->tile_size);
+    } else if (std::strcmp(arg, "--processes") == 0) {
+      ok = int_value(&opts->num_processes);
+    } else if (std::strcmp(arg, "--load") == 0) {
+      const char* v = value();
+      ok = v != nullptr;
+      if (ok) {
+        opts->load_path = v;
+      }
+    } else if (std::strcmp(arg, "--save") == 0) {
+      const char* v = value();
+      ok = v != nullptr;
+      if (ok) {
+        opts->save_path = v;
+      }
+    } else if (std::strcmp(arg, "--no-compress") == 0) {
+      opts->compress_checkpoint = false;
+    } else if (std::strcmp(arg, "--out") == 0) {
+      const char* v = value();
+      ok = v != nullptr;
+      if (ok) {
+        opts->out_dir = v;
+      }
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      std::fprintf(stderr, "bad or incomplete option: %s\n", arg);
+      return false;
+    }
+  }
+  return opts->steps >= 0 && config.num_particles > 0;
+}
+
+//  `member` < 0 for a single simulation.
+bool write_frame(
+  const std::string& out_dir, int member, int step, const uint8_t* rgba, int w, int h) {
+  //
+  //  The padding channel packs to alpha 0, so frames are written without alpha.
+  auto rgb = std::make_unique<uint8_t[]>(w * h * 3);
+  for (int i = 0; i < w * h; i++) {
+    std::memcpy(rgb.get() + i * 3, rgba + i * 4, 3);
+  }
+  char name[64];
+  if (member >= 0) {
+    std::snprintf(name, sizeof(name), "/sim_%03d_frame_%06d.png", member, step);
+  } else {
+    std::snprintf(name, sizeof(name), "/frame_%06d.png", step);
+  }
+  const auto path = out_dir + name;
+  return im::write_image(path.c_str(), rgb.get(), w, h, 3);
+}
+
+void print_summary(
+  const Options& opts, const gen::SimTelemetry& telemetry, double wall_s, int num_threads) {
+  //
+  std::printf(
+    "%d steps, %d particles, %dx%d map, %d threads, %.3f s\n",
+    telemetry.size(), opts.config.num_particles, opts.texture_width, opts.texture_height,
+    num_threads, wall_s);
+  std::printf(
+    "%-10s %10s %10s %10s %10s %10s  (ms/step)\n", "stage", "mean", "p50", "p95", "p99", "max");
+  for (int i = 0; i < gen::num_sim_stages; i++) {
+    const auto stage = gen::SimStage(i);
+    const auto s = telemetry.summarize(stage);
+    std::printf(
+      "%-10s %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+      gen::to_string(stage), s.mean, s.p50, s.p95, s.p99, s.max);
+  }
+}
+
+int run_ensemble(const Options& opts) {
+  gen::SlimeMoldEnsemble ensemble{opts.config.num_threads};
+  for (int i = 0; i < opts.ensemble_size; i++) {
+    auto config = opts.config;
+    config.seed += uint64_t(i);
+    ensemble.add(config, opts.texture_width, opts.texture_height);
+  }
+
+  const int interval = opts.frame_interval > 0 ? opts.frame_interval : opts.steps;
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int step = 0; step < opts.steps;) {
+    const int n = std::min(interval, opts.steps - step);
+    ensemble.step(n);
+    step += n;
+    for (int i = 0; opts.frame_interval > 0 && i < ensemble.size(); i++) {
+      const auto& tex = ensemble.member(i).texture_data;
+      const uint8_t* rgba = tex.rgbau8_texture_data.get();
+      if (!write_frame(opts.out_dir, i, step, rgba, tex.width, tex.height)) {
+        std::fprintf(stderr, "failed to write a frame to %s\n", opts.out_dir.c_str());
+        return 1;
+      }
+    }
+  }
+  const double wall_s = std::chrono::duration<double>(
+    std::chrono::high_resolution_clock::now() - t0).count();
+
+  const double sim_steps = double(opts.steps) * ensemble.size();
+  std::printf(
+    "%d simulations x %d steps, %d particles, %dx%d maps, %d threads, %d batches, %.3f s\n",
+    ensemble.size(), opts.steps, opts.config.num_particles, opts.texture_width,
+    opts.texture_height, ensemble.num_threads(), ensemble.num_batches(), wall_s);
+  std::printf(
+    "%.1f simulation steps/s, %.3g particle steps/s\n",
+    sim_steps / wall_s, sim_steps * opts.config.num_particles / wall_s);
+  return 0;
+}
+
+int run_tiled(const Options& opts) {
+  gen::TiledSlimeMold sim{opts.config, opts.texture_width, opts.texture_height, opts.tile_size};
+  std::printf(
+    "%d tiles of %d texels, %d texel halo\n", sim.num_tiles(), sim.tile_size(), sim.halo_size());
+
+  gen::SimTelemetry telemetry{std::max(1, opts.steps)};
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int step = 1; step <= opts.steps; step++) {
+    telemetry.push(sim.step());
+    if (opts.frame_interval > 0 && step % opts.frame_interval == 0) {
+      const uint8_t* rgba = sim.read_rgbau8_image_data();
+      if (!write_frame(opts.out_dir, -1, step, rgba, sim.width(), sim.height())) {
+        std::fprintf(stderr, "failed to write a frame to %s\n", opts.out_dir.c_str());
+        return 1;
+      }
+    }
+  }
+  const double wall_s = std::chrono::duration<double>(
+    std::chrono::high_resolution_clock::now() - t0).count();
+
+  print_summary(opts, telemetry, wall_s, sim.num_threads());
+  return 0;
+}
+
+//  Band `rank` of a run over segment `name`; band 0 writes the frames and the summary.
+int run_band(const Options& opts, const std::string& name, int rank) {
+  gen::SharedMemorySegment segment;
+  if (!segment.open(name)) {
+    std::fprintf(stderr, "band %d: failed to open %s\n", rank, name.c_str());
+    return 1;
+  }
+  gen::SlimeMoldBandProcess band{segment, rank};
+
+  gen::SimTelemetry telemetry{std::max(1, opts.steps)};
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int step = 1; step <= opts.steps; step++) {
+    gen::UpdateSlimeMoldParticlesResult res;
+    if (!band.step(&res)) {
+      return 1;
+    }
+    telemetry.push(res);
+    if (rank == 0 && opts.frame_interval > 0 && step % opts.frame_interval == 0) {
+      const uint8_t* rgba = band.read_rgbau8_image_data();
+      if (!write_frame(opts.out_dir, -1, step, rgba, band.width(), band.height())) {
+        std::fprintf(stderr, "failed to write a frame to %s\n", opts.out_dir.c_str());
+        return 1;
+      }
+    }
+  }
+  const double wall_s = std::chrono::duration<double>(
+    std::chrono::high_resolution_clock::now() - t0).count();
+
+  if (rank == 0) {
+    std::printf(
+      "%d processes, %d row halo; band 0 (rows %d to %d):\n",
+      band.num_bands(), band.halo_size(), band.band_y0(), band.band_y1());
+    print_summary(opts, telemetry, wall_s, 1);
+  }
+  return 0;
+}
+
+int run_processes(const Options& opts) {
+  const auto name = "/slime_mold_" + std::to_string(getpid());
+  gen::SharedMemorySegment segment;
+  if (!gen::SlimeMoldBandProcess::init_segment(
+    segment, name, opts.config, opts.texture_width, opts.texture_height, opts.num_processes)) {
+    std::fprintf(
+      stderr, "failed to set up %d bands; each band must be at least as tall as the halo\n",
+      opts.num_processes);
+    return 1;
+  }
+
+  std::fflush(stdout);
+  int res{};
+  int num_children{};
+  for (int rank = 0; rank < opts.num_processes; rank++) {
+    const pid_t pid = fork();
+    if (pid == 0) {
+      const int code = run_band(opts, name, rank);
+      std::fflush(stdout);
+      _exit(code);
+    } else if (pid < 0) {
+      gen::SlimeMoldBandProcess::abort(segment);
+      res = 1;
+      break;
+    }
+    num_children++;
+  }
+
+  for (int i = 0; i < num_children; i++) {
+    int status{};
+    if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      gen::SlimeMoldBandProcess::abort(segment);
+      res = 1;
+    }
+  }
+  segment.unlink();
+  return res;
+}
+
+} //  anon
+
+int main(int argc, char** argv) {
+  Options opts;
+  if (!parse_options(argc, argv, &opts)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  const bool single = opts.ensemble_size <= 0 && opts.tile_size < 0 && opts.num_processes <= 0;
+  if (!single && (!opts.load_path.empty() || !opts.save_path.empty())) {
+    std::fprintf(stderr, "--load and --save take a single simulation\n");
+    return 1;
+  }
+  if (opts.ensemble_size > 0) {
+    return run_ensemble(opts);
+  }
+  if (opts.tile_size >= 0) {
+    return run_tiled(opts);
+  }
+  if (opts.num_processes > 0) {
+    return run_processes(opts);
+  }
+
+  auto& config = opts.config;
+  gen::SlimeMoldCheckpoint checkpoint{};
+  const bool resume = !opts.load_path.empty();
+  if (resume) {
+    if (!gen::load_slime_mold_checkpoint(opts.load_path, &checkpoint)) {
+      std::fprintf(stderr, "failed to load a checkpoint from %s\n", opts.load_path.c_str());
+      return 1;
+    }
+    checkpoint.config.num_threads = config.num_threads;
+    config = checkpoint.config;
+    opts.texture_width = checkpoint.texture_data.width;
+    opts.texture_height = checkpoint.texture_data.height;
+  }
+  auto texture_data = resume ? std::move(checkpoint.texture_data) :
+    gen::make_default_slime_mold_texture_data(
+      opts.texture_width, opts.texture_height, config.map_storage_type);
+  auto particles = resume ?
+    std::move(checkpoint.particles) : gen::make_slime_mold_particles(config);
+  gen::SlimeMoldParams params = resume ? checkpoint.params : gen::SlimeMoldParams{};
+  gen::DirectionInfluencingImage dir_im{};
+  gen::SlimeMoldSimulationWorkspace workspace;
+  gen::ThreadPool pool;
+
+  gen::SlimeMoldSimulationContext context{};
+  context.map_storage_type = texture_data.map_storage_type;
+  context.texture_width = texture_data.width;
+  context.texture_height = texture_data.height;
+  context.texture_data0 = texture_data.texture_data0.get();
+  context.perturb_data = texture_data.perturb_data.get();
+  context.signal_data = texture_data.signal_data.get();
+  context.rgbau8_texture_data0 = texture_data.rgbau8_texture_data.get();
+  context.params = &params;
+  context.direction_influencing_image = &dir_im;
+  context.thread_pool = &pool;
+  context.workspace = &workspace;
+  if (resume) {
+    gen::restore_slime_mold_context_state(checkpoint, &context);
+  }
+
+  gen::SimTelemetry telemetry{std::max(1, opts.steps)};
+  auto t0 = std::chrono::high_resolution_clock::now();
+  for (int step = 1; step <= opts.steps; step++) {
+    telemetry.push(gen::update_slime_mold_particles(particles, config, &context));
+    if (opts.frame_interval > 0 && step % opts.frame_interval == 0) {
+      const int w = opts.texture_width;
+      const int h = opts.texture_height;
+      //  numbered from the start of the run, resumed or not
+      const int frame = int(context.tot_iter);
+      if (!write_frame(opts.out_dir, -1, frame, context.rgbau8_texture_data0, w, h)) {
+        std::fprintf(stderr, "failed to write a frame to %s\n", opts.out_dir.c_str());
+        return 1;
+      }
+    }
+  }
+  const double wall_s = std::chrono::duration<double>(
+    std::chrono::high_resolution_clock::now() - t0).count();
+
+  print_summary(opts, telemetry, wall_s, pool.num_threads());
+  if (!opts.save_path.empty() &&
+      !gen::save_slime_mold_checkpoint(
+        opts.save_path, particles, config, context, opts.compress_checkpoint)) {
+    std::fprintf(stderr, "failed to save a checkpoint to %s\n", opts.save_path.c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -10,6 +10,7 @@
 #include <stb_image_write.h>
 
 #include <cmath>
+#include <cstring>
 #include <algorithm>
 #include <optional>
 #include <limits>
@@ -180,10 +181,10 @@ bool im::read_image(
   return load_image_impl<uint8_t>(file_path, flip_y_on_load, dst, width, height, num_components);
 }
 
-void im::write_image(
+bool im::write_image(
   const char* file_path, uint8_t* dst, int width, int height, int num_components) {
   //
-  stbi_write_png(file_path, width, height, num_components, dst, 0);
+  return stbi_write_png(file_path, width, height, num_components, dst, 0) != 0;
 }
 
 void im::resize_image(const uint8_t* src, int sw, int sh, int nc, uint8_t* dst, int dw, int dh) {
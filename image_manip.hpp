@@ -14,7 +14,8 @@ bool read_image(
   const char* file_path, bool flip_y_on_load,
   std::unique_ptr<uint8_t[]>& dst, int* width, int* height, int* num_components);
 
-void write_image(
+//  Writes a PNG; false on failure.
+bool write_image(
   const char* file_path, uint8_t* dst, int width, int height, int num_components);
 
 void resize_image(
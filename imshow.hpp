@@ -4,6 +4,14 @@
 
 namespace gfx {
 
+//  Pixels [x0, x1) x [y0, y1) of an image.
+struct ImageRect {
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+};
+
 struct Context {
   int surface_width;
   int surface_height;
@@ -16,8 +24,10 @@ struct Context {
 void* boot();
 void terminate();
 void gui_new_frame();
+//  Uploads the parts of `image_data` in `dirty_rects`; all of it when the texture is (re)made.
 void begin_frame(
-  const Context& context, const void* image_data, const uint8_t* dir_image, int dir_im_dim);
+  const Context& context, const void* image_data, const ImageRect* dirty_rects,
+  int num_dirty_rects, const uint8_t* dir_image, int dir_im_dim);
 void render();
 
 }
\ No newline at end of file
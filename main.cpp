@@ -12,6 +12,8 @@
 #endif
 
 #include <GLFW/glfw3.h>
+#include <cstdio>
+#include <vector>
 
 //  ------------------------------------------------------------------------------------
 
@@ -34,20 +36,25 @@ struct {
   float cursor_x{};
   float cursor_y{};
   float dir_image_mix{};
+  std::vector<gfx::ImageRect> dirty_rects;
 } globals;
 
 gen::UpdateSlimeMoldParticlesResult main_update() {
   return globals.sm.update();
 }
 
-void main_gui_update(const gen::UpdateSlimeMoldParticlesResult& sim_res) {
+void main_gui_update() {
   const float fps = ImGui::GetIO().Framerate;
 
   gfx::gui_new_frame();
 
-  auto res = render_gui(globals.sm, {
-    fps, sim_res.dt_ms, &globals.use_bw, &globals.full_screen_image,
-    &globals.dir_image_mix, globals.cursor_x, globals.cursor_y});
+  GUIUpdateResult res;
+  {
+    auto lock = globals.sm.lock_shared_state();
+    res = render_gui(globals.sm, {
+      fps, &globals.use_bw, &globals.full_screen_image,
+      &globals.dir_image_mix, globals.cursor_x, globals.cursor_y});
+  }
   globals.sm.on_gui_update(res);
 }
 
@@ -83,7 +90,8 @@ static void get_window_dimensions(int* dw, int* dh) {
 }
 #endif
 
-int main(int, char**) {
+//  An optional argument names a checkpoint to start from.
+int main(int argc, char** argv) {
 #ifdef SM_IS_EMSCRIPTEN
   emscripten_set_mousemove_callback(EMSCRIPTEN_EVENT_TARGET_WINDOW, 0, 1, mouse_move_callback);
 #endif
@@ -96,12 +104,17 @@ int main(int, char**) {
   font::initialize_text_rasterizer();
 
   init_gui();
+  if (argc > 1 && !globals.sm.load_checkpoint(argv[1])) {
+    std::fprintf(stderr, "failed to load a checkpoint from %s\n", argv[1]);
+  }
+  globals.sm.start_sim_thread();
 #ifdef SM_IS_EMSCRIPTEN
   emscripten_set_main_loop_arg(main_loop, window, 0, false);
 #else
   while (!glfwWindowShouldClose((GLFWwindow*) window)) {
     main_loop(window);
   }
+  globals.sm.stop_sim_thread();
   font::terminate_text_rasterizer();
   gfx::terminate();
 #endif
@@ -127,7 +140,15 @@ void main_begin_frame(GLFWwindow* window) {
   }
 #endif
 
-  const uint8_t* tex_data = globals.sm.read_rgbau8_image_data();
+  auto lock = globals.sm.lock_shared_state();
+  globals.sm.take_frame();
+  int tex_dim{};
+  const uint8_t* tex_data = globals.sm.read_rgbau8_image_data(&tex_dim);
+  globals.dirty_rects.clear();
+  for (auto& r : globals.sm.read_rgbau8_dirty_region().rects) {
+    globals.dirty_rects.push_back({r.x0, r.y0, r.x1, r.y1});
+  }
+  globals.sm.clear_rgbau8_dirty_region();
   int dir_im_dim{};
   const uint8_t* dir_im_data = globals.sm.read_r_dir_image_data(&dir_im_dim);
 
@@ -136,15 +157,16 @@ void main_begin_frame(GLFWwindow* window) {
     height,
     globals.use_bw,
     globals.full_screen_image,
-    globals.sm.get_texture_dim(),
+    tex_dim,
     globals.dir_image_mix
-  }, tex_data, dir_im_data, dir_im_dim);
+  }, tex_data, globals.dirty_rects.data(), int(globals.dirty_rects.size()), dir_im_data,
+    dir_im_dim);
 }
 
 static void main_loop(void* window) {
   glfwPollEvents();
-  const auto sim_res = main_update();
+  main_update();
   main_begin_frame((GLFWwindow*) window);
-  main_gui_update(sim_res);
+  main_gui_update();
   main_render();
 }
\ No newline at end of file
@@ -0,0 +1,328 @@
+#pragma once
+
+#include "util.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace gen {
+
+/*
+ * Element types the trail, perturb and signal maps can be stored as. Map values are always in
+ * [0, 1]; kernels widen elements to float when they load them and narrow them back on store, so
+ * only memory traffic is reduced-precision.
+ *
+ *  IntegralType::Float         : float
+ *  IntegralType::HalfFloat     : Half (IEEE binary16)
+ *  IntegralType::UnsignedShort : Unorm16 (v * 65535, rounded)
+ */
+struct Half {
+  uint16_t bits;
+};
+
+struct Unorm16 {
+  uint16_t bits;
+};
+
+inline float half_to_float(uint16_t h) {
+#if defined(__F16C__)
+  return _cvtsh_ss(h);
+#else
+  //  Rebias the exponent with a multiply, which also handles denormals. Inf and NaN are not
+  //  representable in a map and are not special-cased.
+  const uint32_t exp_mant = uint32_t(h & 0x7fffu) << 13;
+  const uint32_t sign = uint32_t(h & 0x8000u) << 16;
+  const float mag = std::bit_cast<float>(exp_mant) * 0x1p112f;
+  return std::bit_cast<float>(std::bit_cast<uint32_t>(mag) | sign);
+#endif
+}
+
+//  Round to nearest even.
+inline uint16_t float_to_half(float f) {
+#if defined(__F16C__)
+  return uint16_t(_cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT));
+#else
+  constexpr uint32_t f32_infty = 255u << 23;
+  constexpr uint32_t f16_max = (127u + 16u) << 23;
+  constexpr uint32_t denorm_magic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+  uint32_t fb = std::bit_cast<uint32_t>(f);
+  const uint32_t sign = fb & 0x80000000u;
+  fb ^= sign;
+
+  uint32_t o;
+  if (fb >= f16_max) {
+    o = fb > f32_infty ? 0x7e00u : 0x7c00u;
+  } else if (fb < (113u << 23)) {
+    //  denormal half; let the float adder do the rounding
+    const float t = std::bit_cast<float>(fb) + std::bit_cast<float>(denorm_magic);
+    o = std::bit_cast<uint32_t>(t) - denorm_magic;
+  } else {
+    const uint32_t mant_odd = (fb >> 13) & 1u;
+    fb += (uint32_t(15 - 127) << 23) + 0xfffu;
+    fb += mant_odd;
+    o = fb >> 13;
+  }
+
+  return uint16_t(o | (sign >> 16));
+#endif
+}
+
+inline float to_float(float v) {
+  return v;
+}
+
+inline float to_float(Half v) {
+  return half_to_float(v.bits);
+}
+
+inline float to_float(Unorm16 v) {
+  return float(v.bits) * (1.0f / 65535.0f);
+}
+
+template <typename T>
+T from_float(float v);
+
+template <>
+inline float from_float<float>(float v) {
+  return v;
+}
+
+template <>
+inline Half from_float<Half>(float v) {
+  return {float_to_half(v)};
+}
+
+template <>
+inline Unorm16 from_float<Unorm16>(float v) {
+  v = std::min(1.0f, std::max(0.0f, v));
+  return {uint16_t(v * 65535.0f + 0.5f)};
+}
+
+template <typename T>
+void widen(const T* src, float* dst, int n) {
+  for (int i = 0; i < n; i++) {
+    dst[i] = to_float(src[i]);
+  }
+}
+
+template <typename T>
+void narrow(const float* src, T* dst, int n) {
+  for (int i = 0; i < n; i++) {
+    dst[i] = from_float<T>(src[i]);
+  }
+}
+
+#if defined(__AVX2__)
+template <>
+inline void widen<Unorm16>(const Unorm16* src, float* dst, int n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / 65535.0f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i u = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    const __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(u));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(f, scale));
+  }
+  for (; i < n; i++) {
+    dst[i] = to_float(src[i]);
+  }
+}
+
+template <>
+inline void narrow<Unorm16>(const float* src, Unorm16* dst, int n) {
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 scale = _mm256_set1_ps(65535.0f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), zero), one);
+    const __m256i u = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(v, scale), half));
+    //  packus works within 128-bit lanes; gather the two halves into the low lane
+    const __m256i p = _mm256_permute4x64_epi64(_mm256_packus_epi32(u, u), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm256_castsi256_si128(p));
+  }
+  for (; i < n; i++) {
+    dst[i] = from_float<Unorm16>(src[i]);
+  }
+}
+#endif
+
+#if defined(__F16C__)
+template <>
+inline void widen<Half>(const Half* src, float* dst, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+  }
+  for (; i < n; i++) {
+    dst[i] = to_float(src[i]);
+  }
+}
+
+template <>
+inline void narrow<Half>(const float* src, Half* dst, int n) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+  }
+  for (; i < n; i++) {
+    dst[i] = from_float<Half>(src[i]);
+  }
+}
+#endif
+
+/*
+ * A map of `width` x `height` texels. Every map in the simulation has the same memory order:
+ *
+ *  - texels are stored row by row; y selects the row and x the texel within it;
+ *  - each texel is 4 consecutive elements, R, G, B and a padding channel that is always 0.
+ *
+ * So texel (x, y) starts at element (y * width + x) * 4, each row is width * 4 elements, and
+ * every texel starts on a 4-element boundary.
+ */
+template <typename T>
+struct MapView {
+  using element_type = T;
+  static constexpr int channels = 4;
+  static constexpr int color_channels = 3;
+
+  operator MapView<const T>() const requires (!std::is_const_v<T>) {
+    return {data, width, height};
+  }
+
+  int offset(int x, int y) const {
+    return (y * width + x) * channels;
+  }
+  T* texel(int x, int y) const {
+    return data + offset(x, y);
+  }
+  T* row(int y) const {
+    return data + y * row_size();
+  }
+  int row_size() const {
+    return width * channels;
+  }
+  int size() const {
+    return width * height * channels;
+  }
+  bool contains(int x, int y) const {
+    return x >= 0 && y >= 0 && x < width && y < height;
+  }
+
+  T* data;
+  int width;
+  int height;
+};
+
+/*
+ * A MapView with dimensions fixed at compile time, for instantiating kernels at common map sizes
+ * so that texel offsets and bounds checks fold to constants.
+ */
+template <typename T, int Width, int Height>
+struct FixedMapView {
+  using element_type = T;
+  static constexpr int channels = MapView<T>::channels;
+  static constexpr int color_channels = MapView<T>::color_channels;
+  static constexpr int width = Width;
+  static constexpr int height = Height;
+
+  operator MapView<T>() const {
+    return {data, width, height};
+  }
+
+  static constexpr int offset(int x, int y) {
+    return (y * width + x) * channels;
+  }
+  T* texel(int x, int y) const {
+    return data + offset(x, y);
+  }
+  T* row(int y) const {
+    return data + y * row_size();
+  }
+  static constexpr int row_size() {
+    return width * channels;
+  }
+  static constexpr int size() {
+    return width * height * channels;
+  }
+  static constexpr bool contains(int x, int y) {
+    return x >= 0 && y >= 0 && x < width && y < height;
+  }
+
+  T* data;
+};
+
+/*
+ * Part of a `width` x `height` map held in its own buffer: texels [x0, x0 + stride) x [y0, ...),
+ * with rows `stride` texels apart. Coordinates and `contains` are those of the whole map, so
+ * kernels written against MapView work on a window unchanged, as long as every texel they touch
+ * is inside it.
+ */
+template <typename T>
+struct MapWindowView {
+  using element_type = T;
+  static constexpr int channels = MapView<T>::channels;
+  static constexpr int color_channels = MapView<T>::color_channels;
+
+  operator MapWindowView<const T>() const requires (!std::is_const_v<T>) {
+    return {data, width, height, x0, y0, stride};
+  }
+
+  int offset(int x, int y) const {
+    return ((y - y0) * stride + (x - x0)) * channels;
+  }
+  T* texel(int x, int y) const {
+    return data + offset(x, y);
+  }
+  bool contains(int x, int y) const {
+    return x >= 0 && y >= 0 && x < width && y < height;
+  }
+
+  T* data;
+  int width;
+  int height;
+  int x0;
+  int y0;
+  int stride;
+};
+
+//  Element type of a MapView, FixedMapView or MapWindowView, without const.
+template <typename View>
+using map_element_t = std::remove_const_t<typename View::element_type>;
+
+/*
+ * Calls `f` with `view` as a FixedMapView when it is square and of a common size, and as itself
+ * otherwise; `f` must accept either.
+ */
+template <typename T, typename F>
+decltype(auto) with_fixed_map_dims(MapView<T> view, F&& f) {
+  if (view.width == view.height) {
+    switch (view.width) {
+      case 256:
+        return f(FixedMapView<T, 256, 256>{view.data});
+      case 512:
+        return f(FixedMapView<T, 512, 512>{view.data});
+      case 1024:
+        return f(FixedMapView<T, 1024, 1024>{view.data});
+      case 2048:
+        return f(FixedMapView<T, 2048, 2048>{view.data});
+    }
+  }
+  return f(view);
+}
+
+inline bool is_map_storage_type(IntegralType type) {
+  return type == IntegralType::Float ||
+         type == IntegralType::HalfFloat ||
+         type == IntegralType::UnsignedShort;
+}
+
+}
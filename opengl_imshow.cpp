@@ -8,6 +8,7 @@
 #include <imgui.h>
 #include <backends/imgui_impl_glfw.h>
 #include <backends/imgui_impl_opengl3.h>
+#include <algorithm>
 #include <iostream>
 
 namespace {
@@ -21,6 +22,7 @@ struct {
   int height{};
   int texture_dim{};
   GLuint texture{};
+  bool need_full_upload{};
   GLuint program{};
   GLuint vao{};
   GLuint dummy_texture{};
@@ -101,6 +103,7 @@ bool create_main_texture(int dim) {
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dim, dim, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
   glBindTexture(GL_TEXTURE_2D, 0);
   globals.texture_dim = dim;
+  globals.need_full_upload = true;
   return true;
 }
 
@@ -368,7 +371,8 @@ void gfx::gui_new_frame() {
 }
 
 void gfx::begin_frame(
-  const Context& context, const void* image_data, const uint8_t* dir_im, int dir_im_dim) {
+  const Context& context, const void* image_data, const ImageRect* dirty_rects,
+  int num_dirty_rects, const uint8_t* dir_im, int dir_im_dim) {
   //
   globals.prepared = false;
   globals.use_dir_image = false;
@@ -402,10 +406,29 @@ void gfx::begin_frame(
     }
   }
 
-  {
+  if (image_data) {
     const int dim = context.texture_dim;
     glBindTexture(GL_TEXTURE_2D, globals.texture);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, dim, dim, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
+    if (globals.need_full_upload) {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, dim, dim, GL_RGBA, GL_UNSIGNED_BYTE, image_data);
+      globals.need_full_upload = false;
+    } else if (num_dirty_rects > 0) {
+      //  rows of a rect are a full image row apart in `image_data`
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, dim);
+      for (int i = 0; i < num_dirty_rects; i++) {
+        const auto& r = dirty_rects[i];
+        const int x0 = std::max(0, r.x0);
+        const int y0 = std::max(0, r.y0);
+        const int x1 = std::min(dim, r.x1);
+        const int y1 = std::min(dim, r.y1);
+        if (x1 > x0 && y1 > y0) {
+          const auto* src = static_cast<const uint8_t*>(image_data) + (y0 * dim + x0) * 4;
+          glTexSubImage2D(
+            GL_TEXTURE_2D, 0, x0, y0, x1 - x0, y1 - y0, GL_RGBA, GL_UNSIGNED_BYTE, src);
+        }
+      }
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
   }
 
   if (dir_im) {
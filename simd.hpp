@@ -0,0 +1,379 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+
+/*
+ * Thin wrappers over the native float vector type of the target. Exactly one backend is selected
+ * at compile time; when none is available, SM_SIMD_ENABLED is 0 and callers are expected to use
+ * their scalar path.
+ *
+ *  AVX2 (-mavx2 -mfma)   : 8 lanes
+ *  SSE2 (x86-64 default) : 4 lanes
+ *  wasm simd128 (-msimd128) : 4 lanes
+ */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SM_SIMD_AVX2 (1)
+#define SM_SIMD_ENABLED (1)
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SM_SIMD_SSE2 (1)
+#define SM_SIMD_ENABLED (1)
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define SM_SIMD_WASM (1)
+#define SM_SIMD_ENABLED (1)
+#else
+#define SM_SIMD_ENABLED (0)
+#endif
+
+#if SM_SIMD_ENABLED
+
+namespace simd {
+
+#if SM_SIMD_AVX2
+
+constexpr int width = 8;
+
+struct F32 {
+  __m256 v;
+};
+
+struct I32 {
+  __m256i v;
+};
+
+//  All bits set in active lanes.
+struct Mask {
+  __m256 v;
+};
+
+inline F32 set1(float v) { return {_mm256_set1_ps(v)}; }
+inline I32 set1i(int32_t v) { return {_mm256_set1_epi32(v)}; }
+inline F32 load(const float* p) { return {_mm256_loadu_ps(p)}; }
+inline I32 load(const int32_t* p) { return {_mm256_loadu_si256((const __m256i*) p)}; }
+inline void store(float* p, F32 a) { _mm256_storeu_ps(p, a.v); }
+inline void store(int32_t* p, I32 a) { _mm256_storeu_si256((__m256i*) p, a.v); }
+
+inline F32 operator+(F32 a, F32 b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline F32 operator-(F32 a, F32 b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline F32 operator*(F32 a, F32 b) { return {_mm256_mul_ps(a.v, b.v)}; }
+inline F32 operator/(F32 a, F32 b) { return {_mm256_div_ps(a.v, b.v)}; }
+inline F32 min(F32 a, F32 b) { return {_mm256_min_ps(a.v, b.v)}; }
+inline F32 max(F32 a, F32 b) { return {_mm256_max_ps(a.v, b.v)}; }
+inline F32 sqrt(F32 a) { return {_mm256_sqrt_ps(a.v)}; }
+inline F32 floor(F32 a) { return {_mm256_floor_ps(a.v)}; }
+
+inline Mask operator<(F32 a, F32 b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline Mask operator<=(F32 a, F32 b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+inline Mask operator>=(F32 a, F32 b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+inline Mask operator&(Mask a, Mask b) { return {_mm256_and_ps(a.v, b.v)}; }
+inline Mask operator|(Mask a, Mask b) { return {_mm256_or_ps(a.v, b.v)}; }
+inline Mask and_not(Mask a, Mask b) { return {_mm256_andnot_ps(b.v, a.v)}; }
+inline int bits(Mask a) { return _mm256_movemask_ps(a.v); }
+inline F32 select(Mask m, F32 a, F32 b) { return {_mm256_blendv_ps(b.v, a.v, m.v)}; }
+
+inline I32 operator+(I32 a, I32 b) { return {_mm256_add_epi32(a.v, b.v)}; }
+inline I32 operator-(I32 a, I32 b) { return {_mm256_sub_epi32(a.v, b.v)}; }
+inline I32 operator*(I32 a, I32 b) { return {_mm256_mullo_epi32(a.v, b.v)}; }
+inline I32 operator&(I32 a, I32 b) { return {_mm256_and_si256(a.v, b.v)}; }
+inline I32 operator|(I32 a, I32 b) { return {_mm256_or_si256(a.v, b.v)}; }
+template <int N> inline I32 shl(I32 a) { return {_mm256_slli_epi32(a.v, N)}; }
+inline Mask operator<(I32 a, I32 b) { return {_mm256_castsi256_ps(_mm256_cmpgt_epi32(b.v, a.v))}; }
+inline Mask eq(I32 a, I32 b) { return {_mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v))}; }
+inline I32 to_int(F32 a) { return {_mm256_cvttps_epi32(a.v)}; }
+inline F32 to_float(I32 a) { return {_mm256_cvtepi32_ps(a.v)}; }
+inline F32 as_float(I32 a) { return {_mm256_castsi256_ps(a.v)}; }
+inline I32 as_int(F32 a) { return {_mm256_castps_si256(a.v)}; }
+
+//  2^n for integral n in the normal float range.
+inline F32 pow2i(I32 n) {
+  return {_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n.v, _mm256_set1_epi32(127)), 23))};
+}
+
+//  Lanes outside `mask` read 0 and do not touch memory.
+inline F32 gather(const float* base, I32 idx, Mask mask) {
+  return {_mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, idx.v, mask.v, 4)};
+}
+
+inline F32 gather(const float* base, I32 idx) {
+  return {_mm256_i32gather_ps(base, idx.v, 4)};
+}
+
+#elif SM_SIMD_SSE2
+
+constexpr int width = 4;
+
+struct F32 {
+  __m128 v;
+};
+
+struct I32 {
+  __m128i v;
+};
+
+struct Mask {
+  __m128 v;
+};
+
+inline F32 set1(float v) { return {_mm_set1_ps(v)}; }
+inline I32 set1i(int32_t v) { return {_mm_set1_epi32(v)}; }
+inline F32 load(const float* p) { return {_mm_loadu_ps(p)}; }
+inline I32 load(const int32_t* p) { return {_mm_loadu_si128((const __m128i*) p)}; }
+inline void store(float* p, F32 a) { _mm_storeu_ps(p, a.v); }
+inline void store(int32_t* p, I32 a) { _mm_storeu_si128((__m128i*) p, a.v); }
+
+inline F32 operator+(F32 a, F32 b) { return {_mm_add_ps(a.v, b.v)}; }
+inline F32 operator-(F32 a, F32 b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline F32 operator*(F32 a, F32 b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline F32 operator/(F32 a, F32 b) { return {_mm_div_ps(a.v, b.v)}; }
+inline F32 min(F32 a, F32 b) { return {_mm_min_ps(a.v, b.v)}; }
+inline F32 max(F32 a, F32 b) { return {_mm_max_ps(a.v, b.v)}; }
+inline F32 sqrt(F32 a) { return {_mm_sqrt_ps(a.v)}; }
+
+inline Mask operator<(F32 a, F32 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline Mask operator<=(F32 a, F32 b) { return {_mm_cmple_ps(a.v, b.v)}; }
+inline Mask operator>=(F32 a, F32 b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline Mask operator&(Mask a, Mask b) { return {_mm_and_ps(a.v, b.v)}; }
+inline Mask operator|(Mask a, Mask b) { return {_mm_or_ps(a.v, b.v)}; }
+inline Mask and_not(Mask a, Mask b) { return {_mm_andnot_ps(b.v, a.v)}; }
+inline int bits(Mask a) { return _mm_movemask_ps(a.v); }
+inline F32 select(Mask m, F32 a, F32 b) {
+  return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))};
+}
+
+inline I32 operator+(I32 a, I32 b) { return {_mm_add_epi32(a.v, b.v)}; }
+inline I32 operator-(I32 a, I32 b) { return {_mm_sub_epi32(a.v, b.v)}; }
+inline I32 operator*(I32 a, I32 b) {
+  //  no _mm_mullo_epi32 before SSE4.1
+  __m128i even = _mm_mul_epu32(a.v, b.v);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a.v, 32), _mm_srli_epi64(b.v, 32));
+  return {_mm_unpacklo_epi32(
+    _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)))};
+}
+inline I32 operator&(I32 a, I32 b) { return {_mm_and_si128(a.v, b.v)}; }
+inline I32 operator|(I32 a, I32 b) { return {_mm_or_si128(a.v, b.v)}; }
+template <int N> inline I32 shl(I32 a) { return {_mm_slli_epi32(a.v, N)}; }
+inline Mask operator<(I32 a, I32 b) { return {_mm_castsi128_ps(_mm_cmplt_epi32(a.v, b.v))}; }
+inline Mask eq(I32 a, I32 b) { return {_mm_castsi128_ps(_mm_cmpeq_epi32(a.v, b.v))}; }
+inline I32 to_int(F32 a) { return {_mm_cvttps_epi32(a.v)}; }
+inline F32 to_float(I32 a) { return {_mm_cvtepi32_ps(a.v)}; }
+inline F32 as_float(I32 a) { return {_mm_castsi128_ps(a.v)}; }
+inline I32 as_int(F32 a) { return {_mm_castps_si128(a.v)}; }
+
+inline F32 floor(F32 a) {
+  //  no _mm_floor_ps before SSE4.1; valid for |a| < 2^31
+  F32 t = to_float(to_int(a));
+  return select(a < t, t - set1(1.0f), t);
+}
+
+inline F32 pow2i(I32 n) {
+  return {_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n.v, _mm_set1_epi32(127)), 23))};
+}
+
+#elif SM_SIMD_WASM
+
+constexpr int width = 4;
+
+struct F32 {
+  v128_t v;
+};
+
+struct I32 {
+  v128_t v;
+};
+
+struct Mask {
+  v128_t v;
+};
+
+inline F32 set1(float v) { return {wasm_f32x4_splat(v)}; }
+inline I32 set1i(int32_t v) { return {wasm_i32x4_splat(v)}; }
+inline F32 load(const float* p) { return {wasm_v128_load(p)}; }
+inline I32 load(const int32_t* p) { return {wasm_v128_load(p)}; }
+inline void store(float* p, F32 a) { wasm_v128_store(p, a.v); }
+inline void store(int32_t* p, I32 a) { wasm_v128_store(p, a.v); }
+
+inline F32 operator+(F32 a, F32 b) { return {wasm_f32x4_add(a.v, b.v)}; }
+inline F32 operator-(F32 a, F32 b) { return {wasm_f32x4_sub(a.v, b.v)}; }
+inline F32 operator*(F32 a, F32 b) { return {wasm_f32x4_mul(a.v, b.v)}; }
+inline F32 operator/(F32 a, F32 b) { return {wasm_f32x4_div(a.v, b.v)}; }
+inline F32 min(F32 a, F32 b) { return {wasm_f32x4_pmin(a.v, b.v)}; }
+inline F32 max(F32 a, F32 b) { return {wasm_f32x4_pmax(a.v, b.v)}; }
+inline F32 sqrt(F32 a) { return {wasm_f32x4_sqrt(a.v)}; }
+inline F32 floor(F32 a) { return {wasm_f32x4_floor(a.v)}; }
+
+inline Mask operator<(F32 a, F32 b) { return {wasm_f32x4_lt(a.v, b.v)}; }
+inline Mask operator<=(F32 a, F32 b) { return {wasm_f32x4_le(a.v, b.v)}; }
+inline Mask operator>=(F32 a, F32 b) { return {wasm_f32x4_ge(a.v, b.v)}; }
+inline Mask operator&(Mask a, Mask b) { return {wasm_v128_and(a.v, b.v)}; }
+inline Mask operator|(Mask a, Mask b) { return {wasm_v128_or(a.v, b.v)}; }
+inline Mask and_not(Mask a, Mask b) { return {wasm_v128_andnot(a.v, b.v)}; }
+inline int bits(Mask a) { return int(wasm_i32x4_bitmask(a.v)); }
+inline F32 select(Mask m, F32 a, F32 b) { return {wasm_v128_bitselect(a.v, b.v, m.v)}; }
+
+inline I32 operator+(I32 a, I32 b) { return {wasm_i32x4_add(a.v, b.v)}; }
+inline I32 operator-(I32 a, I32 b) { return {wasm_i32x4_sub(a.v, b.v)}; }
+inline I32 operator*(I32 a, I32 b) { return {wasm_i32x4_mul(a.v, b.v)}; }
+inline I32 operator&(I32 a, I32 b) { return {wasm_v128_and(a.v, b.v)}; }
+inline I32 operator|(I32 a, I32 b) { return {wasm_v128_or(a.v, b.v)}; }
+template <int N> inline I32 shl(I32 a) { return {wasm_i32x4_shl(a.v, N)}; }
+inline Mask operator<(I32 a, I32 b) { return {wasm_i32x4_lt(a.v, b.v)}; }
+inline Mask eq(I32 a, I32 b) { return {wasm_i32x4_eq(a.v, b.v)}; }
+inline I32 to_int(F32 a) { return {wasm_i32x4_trunc_sat_f32x4(a.v)}; }
+inline F32 to_float(I32 a) { return {wasm_f32x4_convert_i32x4(a.v)}; }
+inline F32 as_float(I32 a) { return {a.v}; }
+inline I32 as_int(F32 a) { return {a.v}; }
+
+inline F32 pow2i(I32 n) {
+  return {wasm_i32x4_shl(wasm_i32x4_add(n.v, wasm_i32x4_splat(127)), 23)};
+}
+
+#endif
+
+#if SM_SIMD_AVX2
+//  Reads base[idx], base[idx + 1] and base[idx + 2] for each active lane.
+inline void gather3(const float* base, I32 idx, Mask mask, F32* a, F32* b, F32* c) {
+  *a = gather(base, idx, mask);
+  *b = gather(base + 1, idx, mask);
+  *c = gather(base + 2, idx, mask);
+}
+
+/*
+ * 16-bit elements, zero-extended. Each lane reads 32 bits, so base[idx + 3] must be
+ * dereferenceable as well.
+ */
+inline void gather3(const uint16_t* base, I32 idx, Mask mask, I32* a, I32* b, I32* c) {
+  const auto* p = reinterpret_cast<const int*>(base);
+  const __m256i m = _mm256_castps_si256(mask.v);
+  const __m256i lo = _mm256_set1_epi32(0xffff);
+  const __m256i z = _mm256_setzero_si256();
+  *a = {_mm256_and_si256(_mm256_mask_i32gather_epi32(z, p, idx.v, m, 2), lo)};
+  idx = idx + set1i(1);
+  *b = {_mm256_and_si256(_mm256_mask_i32gather_epi32(z, p, idx.v, m, 2), lo)};
+  idx = idx + set1i(1);
+  *c = {_mm256_and_si256(_mm256_mask_i32gather_epi32(z, p, idx.v, m, 2), lo)};
+}
+#else
+/*
+ * Without a hardware gather, lanes are read with scalar loads. Inactive lanes load from `base`
+ * itself (which must be dereferenceable) and are zeroed afterwards, so the loop has no branches.
+ */
+inline F32 gather(const float* base, I32 idx, Mask mask) {
+  alignas(16) int32_t is[width];
+  alignas(16) float vs[width];
+  store(is, idx);
+  const int m = bits(mask);
+  for (int i = 0; i < width; i++) {
+    vs[i] = base[(m & (1 << i)) ? is[i] : 0];
+  }
+  return select(mask, load(vs), set1(0.0f));
+}
+
+inline F32 gather(const float* base, I32 idx) {
+  alignas(16) int32_t is[width];
+  alignas(16) float vs[width];
+  store(is, idx);
+  for (int i = 0; i < width; i++) {
+    vs[i] = base[is[i]];
+  }
+  return load(vs);
+}
+
+inline void gather3(const float* base, I32 idx, Mask mask, F32* a, F32* b, F32* c) {
+  alignas(16) int32_t is[width];
+  alignas(16) float vs[3][width];
+  store(is, idx);
+  const int m = bits(mask);
+  for (int i = 0; i < width; i++) {
+    const float* src = base + ((m & (1 << i)) ? is[i] : 0);
+    vs[0][i] = src[0];
+    vs[1][i] = src[1];
+    vs[2][i] = src[2];
+  }
+  const F32 zero = set1(0.0f);
+  *a = select(mask, load(vs[0]), zero);
+  *b = select(mask, load(vs[1]), zero);
+  *c = select(mask, load(vs[2]), zero);
+}
+
+//  16-bit elements, zero-extended.
+inline void gather3(const uint16_t* base, I32 idx, Mask mask, I32* a, I32* b, I32* c) {
+  alignas(16) int32_t is[width];
+  alignas(16) int32_t vs[3][width];
+  store(is, idx);
+  const int m = bits(mask);
+  for (int i = 0; i < width; i++) {
+    const int32_t keep = -((m >> i) & 1);
+    const uint16_t* src = base + (keep ? is[i] : 0);
+    vs[0][i] = int32_t(src[0]) & keep;
+    vs[1][i] = int32_t(src[1]) & keep;
+    vs[2][i] = int32_t(src[2]) & keep;
+  }
+  *a = load(vs[0]);
+  *b = load(vs[1]);
+  *c = load(vs[2]);
+}
+#endif
+
+/*
+ * Shared helpers, written in terms of the backend primitives above.
+ */
+
+inline F32 operator-(F32 a) {
+  return set1(0.0f) - a;
+}
+
+inline F32 abs(F32 a) {
+  return max(a, -a);
+}
+
+inline bool any(Mask a) {
+  return bits(a) != 0;
+}
+
+inline Mask operator>=(I32 a, I32 b) {
+  return and_not(eq(a, a), a < b);
+}
+
+//  {i, i + 1, ..., i + width - 1}
+inline I32 iota(int32_t i) {
+  alignas(32) int32_t vs[width];
+  for (int j = 0; j < width; j++) {
+    vs[j] = i + j;
+  }
+  return load(vs);
+}
+
+inline int32_t hmax(I32 a) {
+  alignas(32) int32_t vs[width];
+  store(vs, a);
+  int32_t res = vs[0];
+  for (int i = 1; i < width; i++) {
+    res = vs[i] > res ? vs[i] : res;
+  }
+  return res;
+}
+
+//  Cephes-style expf; max relative error ~2 ulp on the clamped domain.
+inline F32 exp(F32 x) {
+  x = min(max(x, set1(-87.3f)), set1(88.3f));
+  F32 fx = floor(x * set1(1.44269504088896341f) + set1(0.5f));
+  x = x - fx * set1(0.693359375f) - fx * set1(-2.12194440e-4f);
+  F32 z = x * x;
+  F32 y = set1(1.9875691500e-4f);
+  y = y * x + set1(1.3981999507e-3f);
+  y = y * x + set1(8.3334519073e-3f);
+  y = y * x + set1(4.1665795894e-2f);
+  y = y * x + set1(1.6666665459e-1f);
+  y = y * x + set1(5.0000001201e-1f);
+  y = y * z + x + set1(1.0f);
+  return y * pow2i(to_int(fx));
+}
+
+} //  simd
+
+#endif
@@ -1,10 +1,12 @@
 #include "slime_mold.hpp"
+#include "slime_mold_kernels.hpp"
 #include "base_math.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+#include "map_storage.hpp"
 #include <chrono>
-
-#if DYNAMIC_TEXTURE_SIZE
-int gen::SlimeMoldConfig::texture_dim = DEFAULT_TEXTURE_SIZE;
-#endif
+#include <cstring>
+#include <utility>
 
 namespace {
 
@@ -15,41 +17,91 @@ inline int ij_to_linear(int i, int j, int cols, int channels) {
   return (i * cols + j) * channels;
 }
 
+/*
+ * One horizontal pass of the box filter over a row of `c` elements of `Nc` channels, with zero
+ * padding: dst(j) = sum(src(j - k_size / 2 .. j - k_size / 2 + k_size - 1)) / k_size. The sum
+ * slides across the row, so the cost per element does not depend on k_size.
+ */
 template <typename Float, int Nc>
-void simple_box_filter(const Float* a, Float* out, Float* tmp, int r, int c, int k_size) {
-  std::fill(out, out + r * c * Nc, Float(0));
-  std::fill(tmp, tmp + r * c * Nc, Float(0));
+void box_filter_row(const Float* src, Float* dst, int c, int k_size) {
+  using Accum = double;
 
-  Float v = Float(1) / Float(k_size);
-  auto k2 = k_size / 2;
+  const Float v = Float(1) / Float(k_size);
+  const int k2 = k_size / 2;
 
-  for (int i = 0; i < r; i++) {
-    for (int j = 0; j < c; j++) {
-      auto* dst = tmp + ij_to_linear(i, j, c, Nc);
-      for (int k = 0; k < k_size; k++) {
-        auto col = k - k2 + j;
-        if (col >= 0 && col < c) {
-          auto* src = a + ij_to_linear(i, col, c, Nc);
-          for (int s = 0; s < Nc; s++) {
-            dst[s] += src[s] * v;
-          }
-        }
+  Accum sum[Nc]{};
+  for (int col = 0; col < std::min(c, k_size - 1 - k2); col++) {
+    for (int s = 0; s < Nc; s++) {
+      sum[s] += src[col * Nc + s];
+    }
+  }
+
+  for (int j = 0; j < c; j++) {
+    const int add = j - k2 + k_size - 1;
+    const int sub = j - k2;
+    if (add < c) {
+      for (int s = 0; s < Nc; s++) {
+        sum[s] += src[add * Nc + s];
       }
     }
+    for (int s = 0; s < Nc; s++) {
+      dst[j * Nc + s] = Float(sum[s] * v);
+    }
+    if (sub >= 0) {
+      for (int s = 0; s < Nc; s++) {
+        sum[s] -= src[sub * Nc + s];
+      }
+    }
+  }
+}
+
+template <typename Float>
+void add_row(double* sum, const Float* src, int n) {
+  for (int k = 0; k < n; k++) {
+    sum[k] += src[k];
   }
+}
 
+template <typename Float>
+void sub_row(double* sum, const Float* src, int n) {
+  for (int k = 0; k < n; k++) {
+    sum[k] -= src[k];
+  }
+}
+
+/*
+ * Separable box filter with zero padding, `box_filter_row` in each direction. The vertical pass
+ * keeps a running sum per column, so rows are read contiguously and the cost per pixel does not
+ * depend on k_size. `out` may be `a`.
+ */
+void box_filter(MapView<const float> a, MapView<float> out, MapView<float> tmp, int k_size) {
+  constexpr int nc = MapView<float>::channels;
+  const int r = a.height;
+  const int c = a.width;
   for (int i = 0; i < r; i++) {
-    for (int j = 0; j < c; j++) {
-      auto* dst = out + ij_to_linear(i, j, c, Nc);
-      for (int k = 0; k < k_size; k++) {
-        auto row = k - k2 + i;
-        if (row >= 0 && row < r) {
-          auto* src = tmp + ij_to_linear(row, j, c, Nc);
-          for (int s = 0; s < Nc; s++) {
-            dst[s] += src[s] * v;
-          }
-        }
-      }
+    box_filter_row<float, nc>(a.row(i), tmp.row(i), c, k_size);
+  }
+
+  const float v = 1.0f / float(k_size);
+  const int k2 = k_size / 2;
+  const int row_size = tmp.row_size();
+  auto col_sum = std::make_unique<double[]>(row_size);
+  for (int row = 0; row < std::min(r, k_size - 1 - k2); row++) {
+    add_row(col_sum.get(), tmp.row(row), row_size);
+  }
+
+  for (int i = 0; i < r; i++) {
+    const int add = i - k2 + k_size - 1;
+    const int sub = i - k2;
+    if (add < r) {
+      add_row(col_sum.get(), tmp.row(add), row_size);
+    }
+    float* dst = out.row(i);
+    for (int k = 0; k < row_size; k++) {
+      dst[k] = float(col_sum[k] * v);
+    }
+    if (sub >= 0) {
+      sub_row(col_sum.get(), tmp.row(sub), row_size);
     }
   }
 }
@@ -73,48 +125,63 @@ constexpr float pif() {
   return float(pi());
 }
 
-#if DYNAMIC_TEXTURE_SIZE
-int data_texture_size() {
-  int tex_dim = Config::texture_dim;
-  constexpr int num_channels = Config::num_texture_channels;
-  return tex_dim * tex_dim * num_channels;
+//  Elements in a map of width x height texels.
+int map_size(int width, int height) {
+  return MapView<float>{nullptr, width, height}.size();
 }
-#else
-constexpr int data_texture_size() {
-  constexpr int tex_dim = Config::texture_dim;
-  constexpr int num_channels = Config::num_texture_channels;
-  return tex_dim * tex_dim * num_channels;
-}
-#endif
 
-Vec3f channel_weights(float center_scale, float rand_scale, float gain) {
+//  Philox streams drawn from under `Config::seed`; see CounterRng.
+enum RandomStream : uint32_t {
+  ParticleInit = 1,   //  index: particle
+  BounceHeading,      //  index: particle (see BounceIndex); sequence: step
+  PerturbNoise,       //  index: row; sequence: step
+  PerturbCircles,     //  sequence: step
+  ParticleRespawn,    //  index: particle; sequence: particle count before
+};
+
+/*
+ * The BounceHeading index of particle `i` of the particles being updated. Engines that update
+ * the particles in parts key each part so that indices stay unique over the whole map.
+ */
+struct BounceIndex {
+  uint32_t first;
+  uint32_t stride;
+
+  uint32_t operator()(int i) const {
+    return first + uint32_t(i) * stride;
+  }
+};
+
+Vec3f channel_weights(CounterRng& rng, float center_scale, float rand_scale, float gain) {
   Vec3f center{};
-  auto ind = int(urand() * 3.0);
+  auto ind = rng.uniform_int(3);
   center[ind] = center_scale;
-  auto c = normalize(center + Vec3f{urandf(), urandf(), urandf()} * rand_scale);
+  auto c = normalize(center + Vec3f{rng.urandf(), rng.urandf(), rng.urandf()} * rand_scale);
   c = clamp_each(c * gain, Vec3f{}, Vec3f{1.0f});
   return c;
 }
 
-Vec3f default_channel_weights() {
-  return channel_weights(1.0f, 0.05f, 1.0f);
+Vec3f default_channel_weights(CounterRng& rng) {
+  return channel_weights(rng, 1.0f, 0.05f, 1.0f);
 }
 
-SlimeParticle make_particle(const Config& config, const Vec2f& pos, float heading) {
+SlimeParticle make_particle(
+  const Config& config, CounterRng& rng, const Vec2f& pos, float heading) {
+  //
   SlimeParticle result{};
   result.position = pos;
   result.heading = heading;
-  result.left_sensor = pif() * (0.25f + urand_11f() * 0.1f);
-  result.right_sensor = -pif() * (0.25f + urand_11f() * 0.1f);
+  result.left_sensor = pif() * (0.25f + rng.urand_11f() * 0.1f);
+  result.right_sensor = -pif() * (0.25f + rng.urand_11f() * 0.1f);
   result.sensor_step_size = 0.02f;
   result.sensor_size = 0.01f;
   result.speed = 0.1f;
   result.deposit = 1.0f;
   //  result.channel_weights = channel_weight(1.0f, 0.5f, 1.25f);
-  result.channel_weights = default_channel_weights();
-  result.sensor_speed_sensitivity = 1.0f + urand_11f() * 0.2f;
+  result.channel_weights = default_channel_weights(rng);
+  result.sensor_speed_sensitivity = 1.0f + rng.urand_11f() * 0.2f;
   result.sensor_speed_sensitivity_scale = 0.1f;
-  result.turn_speed = pif() * 1.0f + urand_11f() * 0.5f;
+  result.turn_speed = pif() * 1.0f + rng.urand_11f() * 0.5f;
   result.right_only = config.only_right_turns;
 
   result.turn_speed *= std::pow(2.0f, float(config.turn_speed_power));
@@ -123,13 +190,38 @@ SlimeParticle make_particle(const Config& config, const Vec2f& pos, float headin
   return result;
 }
 
-std::unique_ptr<float[]> make_texture_data() {
-  return std::make_unique<float[]>(data_texture_size());
+std::unique_ptr<float[]> make_texture_data(int width, int height) {
+  return std::make_unique<float[]>(map_size(width, height));
+}
+
+int map_element_size(IntegralType type) {
+  assert(is_map_storage_type(type));
+  return int(size_of_integral_type(type));
+}
+
+//  Zeroed, which keeps the padding channel at 0.
+std::unique_ptr<unsigned char[]> make_map_data(IntegralType type, int width, int height) {
+  const size_t size = size_t(map_size(width, height)) * map_element_size(type);
+  return std::make_unique<unsigned char[]>(size);
 }
 
-void set_random_data(float* out, int r, int c, int nc) {
-  for (int i = 0; i < r * c * nc; i++) {
-    out[i] = urandf();
+//  Rows draw from their own streams, so they can be filled in any order.
+void set_random_data(MapView<float> out, uint64_t seed, uint32_t sequence, ThreadPool* pool) {
+  auto fill_row = [&](int y) {
+    CounterRng rng(seed, PerturbNoise, uint32_t(y), sequence);
+    for (int x = 0; x < out.width; x++) {
+      float* texel = out.texel(x, y);
+      for (int k = 0; k < out.color_channels; k++) {
+        texel[k] = rng.urandf();
+      }
+    }
+  };
+  if (pool) {
+    pool->parallel_for(out.height, fill_row);
+  } else {
+    for (int y = 0; y < out.height; y++) {
+      fill_row(y);
+    }
   }
 }
 
@@ -137,13 +229,10 @@ Vec2<int> to_ij(const Vec2f& p, int r, int c) {
   return {int(std::floor(p.x * float(c))), int(std::floor(p.y * float(r)))};
 }
 
-int data_offset(int i, int j, int rows, int channels) {
-  return (j * rows + i) * channels;
-}
-
-template <typename Op>
-void apply_in_circle(float* im, int r, int c, int nc,
-                     const Vec2f& p, float radius, const float* value, Op&& op) {
+template <typename T, typename Op>
+void apply_in_circle(MapView<T> im, const Vec2f& p, float radius, const float* value, Op&& op) {
+  const int r = im.height;
+  const int c = im.width;
   auto [imid, jmid] = to_ij(p, r, c);
   auto [i0, j0] = to_ij(p - radius, r, c);
   auto [i1, j1] = to_ij(p + radius, r, c);
@@ -153,62 +242,74 @@ void apply_in_circle(float* im, int r, int c, int nc,
   for (int i = i0; i <= i1; i++) {
     for (int j = j0; j <= j1; j++) {
       Vec2f span{float(i - imid), float(j - jmid)};
-      if (span.length_squared() <= r2 && i >= 0 && j >= 0 && i < r && j < c) {
-        auto off = data_offset(i, j, r, nc);
-        for (int k = 0; k < nc; k++) {
-          im[off + k] = op(im[off + k], value[k]);
+      if (span.length_squared() <= r2 && im.contains(i, j)) {
+        T* texel = im.texel(i, j);
+        for (int k = 0; k < im.color_channels; k++) {
+          texel[k] = from_float<T>(op(to_float(texel[k]), value[k]));
         }
       }
     }
   }
 }
 
-void clamped_add(float* im, int r, int c, int nc,
-                 const Vec2f& p, float radius, const float* value) {
-  apply_in_circle(im, r, c, nc, p, radius, value, [](float a, float b) {
+template <typename T>
+void clamped_add(MapView<T> im, const Vec2f& p, float radius, const float* value) {
+  apply_in_circle(im, p, radius, value, [](float a, float b) {
     return clamp(a + b, 0.0f, 1.0f);
   });
 }
 
-Vec3f sample3(const float* data, int i, int j, int rows, int channels) {
+template <typename View>
+Vec3f sample3(View data, int i, int j) {
   Vec3f res{};
-  auto* s0 = data + data_offset(i, j, rows, channels);
+  auto* s0 = data.texel(i, j);
   for (int k = 0; k < 3; k++) {
-    res[k] += s0[k];
+    res[k] += to_float(s0[k]);
   }
   return res;
 }
 
-void deposit(const SlimeParticle& part, float* data) {
-#if DYNAMIC_TEXTURE_SIZE
-  const auto td = Config::texture_dim;
-#else
-  constexpr auto td = Config::texture_dim;
-#endif
-  constexpr auto nc = Config::num_texture_channels;
-  const auto [i, j] = to_ij(part.position, td, td);
-  auto* out = data + data_offset(i, j, td, nc);
-  const auto num_copy = std::min(3, nc);
-  for (int k = 0; k < num_copy; k++) {
-    out[k] = std::min(1.0f, out[k] + part.deposit * part.channel_weights[k]);
+//  Bits of a SlimeMoldActiveTiles to set for the texels a pass writes; marks nothing when null.
+struct TileMarks {
+  void mark(int i, int j) const {
+    if (bits) {
+      bits[j * tiles_x + i / SlimeMoldActiveTiles::tile_width] = 1;
+    }
+  }
+
+  uint8_t* bits;
+  int tiles_x;
+};
+
+template <typename View>
+void deposit(const SlimeParticles& parts, int pi, View data, TileMarks marks) {
+  using T = map_element_t<View>;
+  const Vec2f p{parts.position_x[pi], parts.position_y[pi]};
+  const auto [i, j] = to_ij(p, data.height, data.width);
+  marks.mark(i, j);
+  T* out = data.texel(i, j);
+  const float dep = parts.deposit[pi];
+  const auto& cw = parts.channel_weights[pi];
+  for (int k = 0; k < data.color_channels; k++) {
+    out[k] = from_float<T>(std::min(1.0f, to_float(out[k]) + dep * cw[k]));
   }
 }
 
-Vec3f sense(const float* data, const Vec2f& p, float win_size, bool average = false) {
-  static_assert(Config::num_texture_channels == 3);
+template <typename View>
+Vec3f sense(View data, const Vec2f& p, float win_size, bool average = false) {
   Vec3f result{};
 
   auto p0 = p - win_size * 0.5f;
   auto p1 = p + win_size * 0.5f;
 
-  auto [i0, j0] = to_ij(p0, Config::texture_dim, Config::texture_dim);
-  auto [i1, j1] = to_ij(p1, Config::texture_dim, Config::texture_dim);
+  auto [i0, j0] = to_ij(p0, data.height, data.width);
+  auto [i1, j1] = to_ij(p1, data.height, data.width);
   int ct{};
 
   for (int i = i0; i <= i1; i++) {
     for (int j = j0; j <= j1; j++) {
-      if (i >= 0 && j >= 0 && i < Config::texture_dim && j < Config::texture_dim) {
-        result += sample3(data, i, j, Config::texture_dim, Config::num_texture_channels);
+      if (data.contains(i, j)) {
+        result += sample3(data, i, j);
         ct++;
       }
     }
@@ -221,22 +322,22 @@ Vec3f sense(const float* data, const Vec2f& p, float win_size, bool average = fa
   return result;
 }
 
-Vec3f sense_circular(const float* data, const Vec2f& p, float win_size, bool average) {
-  static_assert(Config::num_texture_channels == 3);
+template <typename View>
+Vec3f sense_circular(View data, const Vec2f& p, float win_size, bool average) {
   Vec3f result{};
 
   auto p0 = p - win_size * 0.5f;
   auto p1 = p + win_size * 0.5f;
 
-  auto [i0, j0] = to_ij(p0, Config::texture_dim, Config::texture_dim);
-  auto [i1, j1] = to_ij(p1, Config::texture_dim, Config::texture_dim);
+  auto [i0, j0] = to_ij(p0, data.height, data.width);
+  auto [i1, j1] = to_ij(p1, data.height, data.width);
   int ct{};
 
   for (int i = i0; i <= i1; i++) {
     for (int j = j0; j <= j1; j++) {
-      int is = wrap_within_range(i, Config::texture_dim);
-      int js = wrap_within_range(j, Config::texture_dim);
-      result += sample3(data, is, js, Config::texture_dim, Config::num_texture_channels);
+      int is = wrap_within_range(i, data.width);
+      int js = wrap_within_range(j, data.height);
+      result += sample3(data, is, js);
       ct++;
     }
   }
@@ -248,10 +349,165 @@ Vec3f sense_circular(const float* data, const Vec2f& p, float win_size, bool ave
   return result;
 }
 
+/*
+ * Summed-area table of the trail map: entry (x, y) holds the per-channel sum of all texels
+ * (i, j) with i < x and j < y, so the table is (width + 1) x (height + 1) entries and any window
+ * sum is 4 lookups. Entries are laid out like map texels. Sums are kept in double so that differences of
+ * large prefix sums stay exact enough at high resolutions.
+ */
+struct SummedAreaTable {
+  MapView<const double> sums;
+  int width;  //  of the map
+  int height;
+  bool toroidal;
+};
+
+template <typename T>
+void build_summed_area_table_rows(MapView<const T> im, MapView<double> table, int row0, int row1) {
+  constexpr int nc = MapView<double>::channels;
+  for (int j = row0; j < row1; j++) {
+    double* dst = table.row(j + 1);
+    const T* src = im.row(j);
+    double sum[nc]{};
+    std::fill(dst, dst + nc, 0.0);
+    for (int i = 0; i < im.width; i++) {
+      for (int k = 0; k < im.color_channels; k++) {
+        sum[k] += to_float(src[i * nc + k]);
+      }
+      std::copy(sum, sum + nc, dst + (i + 1) * nc);
+    }
+  }
+}
+
+void build_summed_area_table_cols(MapView<double> table, int col0, int col1) {
+  constexpr int nc = MapView<double>::channels;
+  for (int j = 1; j < table.height; j++) {
+    double* dst = table.row(j);
+    const double* prev = table.row(j - 1);
+    for (int k = col0 * nc; k < col1 * nc; k++) {
+      dst[k] += prev[k];
+    }
+  }
+}
+
+/*
+ * Rows are prefix-summed independently, then columns are accumulated down the table in vertical
+ * strips, so both passes split across the pool.
+ */
+template <typename T>
+SummedAreaTable build_summed_area_table(
+  MapView<const T> im, bool toroidal, ThreadPool* pool, SlimeMoldSimulationWorkspace& ws) {
+  //
+  const int w = im.width;
+  const int h = im.height;
+  MapView<double> table{nullptr, w + 1, h + 1};
+  ws.summed_area_table.resize(table.size());
+  table.data = ws.summed_area_table.data();
+  std::fill(table.row(0), table.row(1), 0.0);
+
+  const int num_strips = pool && pool->num_threads() > 1 ? pool->num_threads() * 4 : 1;
+  const int row_strip = (h + num_strips - 1) / num_strips;
+  const int col_strip = (w + 1 + num_strips - 1) / num_strips;
+  auto rows = [&](int s) {
+    build_summed_area_table_rows(
+      im, table, std::min(h, s * row_strip), std::min(h, (s + 1) * row_strip));
+  };
+  auto cols = [&](int s) {
+    build_summed_area_table_cols(
+      table, std::min(w + 1, s * col_strip), std::min(w + 1, (s + 1) * col_strip));
+  };
+
+  if (num_strips > 1) {
+    pool->parallel_for(num_strips, rows);
+    pool->parallel_for(num_strips, cols);
+  } else {
+    rows(0);
+    cols(0);
+  }
+
+  return {table, w, h, toroidal};
+}
+
+int floor_div(int a, int b) {
+  const int q = a / b;
+  return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+//  Sum of texels (i, j) with i < x and j < y, for x in [0, width] and y in [0, height].
+Vec3f sat_at(const SummedAreaTable& sat, int x, int y) {
+  const double* s = sat.sums.texel(x, y);
+  return Vec3f{float(s[0]), float(s[1]), float(s[2])};
+}
+
+/*
+ * Same, for any x, y, over the map tiled infinitely in both directions:
+ * qx * qy whole tiles, qx partial columns, qy partial rows, and the remaining corner.
+ */
+Vec3f sat_at_toroidal(const SummedAreaTable& sat, int x, int y) {
+  const int w = sat.width;
+  const int h = sat.height;
+  const int qx = floor_div(x, w);
+  const int qy = floor_div(y, h);
+  const int rx = x - qx * w;
+  const int ry = y - qy * h;
+  const double* all = sat.sums.texel(w, h);
+  const double* rows = sat.sums.texel(w, ry);
+  const double* cols = sat.sums.texel(rx, h);
+  const double* corner = sat.sums.texel(rx, ry);
+  Vec3f res;
+  for (int k = 0; k < sat.sums.color_channels; k++) {
+    res[k] = float(
+      double(qx) * double(qy) * all[k] + double(qx) * rows[k] + double(qy) * cols[k] + corner[k]);
+  }
+  return res;
+}
+
+/*
+ * Constant-time counterpart of `sense` (clamped; out-of-range texels contribute nothing) and of
+ * `sense_circular` (toroidal; the window wraps and may cover texels more than once).
+ */
+Vec3f sense_sat(const SummedAreaTable& sat, const Vec2f& p, float win_size) {
+  auto [i0, j0] = to_ij(p - win_size * 0.5f, sat.height, sat.width);
+  auto [i1, j1] = to_ij(p + win_size * 0.5f, sat.height, sat.width);
+  if (i1 < i0 || j1 < j0) {
+    return {};
+  }
+
+  if (sat.toroidal && (i0 < 0 || j0 < 0 || i1 >= sat.width || j1 >= sat.height)) {
+    return sat_at_toroidal(sat, i1 + 1, j1 + 1) - sat_at_toroidal(sat, i0, j1 + 1) -
+           sat_at_toroidal(sat, i1 + 1, j0) + sat_at_toroidal(sat, i0, j0);
+  }
+
+  i0 = std::max(0, i0);
+  j0 = std::max(0, j0);
+  i1 = std::min(sat.width - 1, i1);
+  j1 = std::min(sat.height - 1, j1);
+  if (i1 < i0 || j1 < j0) {
+    return {};
+  }
+
+  return sat_at(sat, i1 + 1, j1 + 1) - sat_at(sat, i0, j1 + 1) -
+         sat_at(sat, i1 + 1, j0) + sat_at(sat, i0, j0);
+}
+
 Vec2f to_vec(float t) {
   return {std::cos(t), std::sin(t)};
 }
 
+//  Rotates `v` by the angle whose cosine and sine are `c` and `s`.
+Vec2f rotate(const Vec2f& v, float c, float s) {
+  return {v.x * c - v.y * s, v.x * s + v.y * c};
+}
+
+void update_turn_rotation(SlimeParticles& parts, float dt) {
+  for (int i = 0; i < parts.size(); i++) {
+    const float t = parts.turn_speed[i] * dt;
+    parts.turn_cos[i] = std::cos(t);
+    parts.turn_sin[i] = std::sin(t);
+  }
+  parts.turn_rotation_dt = dt;
+}
+
 float wrap01(float v) {
   while (v < 0.0f) {
     v += 1.0f;
@@ -268,62 +524,446 @@ Vec2f wrap01(Vec2f v) {
   return v;
 }
 
+template <typename View>
 void update_particle(
-  const Config& config, SlimeParticle& part, const float* im,
-  const DirectionInfluencingImage& dir_im) {
+  const Config& config, SlimeParticles& parts, int pi, View im,
+  const SummedAreaTable* sat, const DirectionInfluencingImage& dir_im, uint32_t step,
+  BounceIndex bounce_index) {
   //
-  auto head = to_vec(part.heading);
-  auto left = to_vec(part.left_sensor);
-  auto right = to_vec(part.right_sensor);
-
-  auto vf = sense(im, part.position + head * part.sensor_step_size, part.sensor_size);
-  auto vl = sense(im, part.position + left * part.sensor_step_size, part.sensor_size);
-  auto vr = sense(im, part.position + right * part.sensor_step_size, part.sensor_size);
+  const Vec2f position{parts.position_x[pi], parts.position_y[pi]};
+  const Vec2f head{parts.heading_x[pi], parts.heading_y[pi]};
+  const Vec2f left{parts.left_sensor_x[pi], parts.left_sensor_y[pi]};
+  const Vec2f right{parts.right_sensor_x[pi], parts.right_sensor_y[pi]};
+  const float sensor_step_size = parts.sensor_step_size[pi];
+  const float sensor_size = parts.sensor_size[pi];
+  const auto& channel_weights = parts.channel_weights[pi];
+
+  Vec3f vf, vl, vr;
+  if (sat) {
+    vf = sense_sat(*sat, position + head * sensor_step_size, sensor_size);
+    vl = sense_sat(*sat, position + left * sensor_step_size, sensor_size);
+    vr = sense_sat(*sat, position + right * sensor_step_size, sensor_size);
+  } else {
+    vf = sense(im, position + head * sensor_step_size, sensor_size);
+    vl = sense(im, position + left * sensor_step_size, sensor_size);
+    vr = sense(im, position + right * sensor_step_size, sensor_size);
+  }
 
-  vf *= part.channel_weights;
-  vl *= part.channel_weights;
-  vr *= part.channel_weights;
+  vf *= channel_weights;
+  vl *= channel_weights;
+  vr *= channel_weights;
 
   float vs[3] = {vf.length(), vl.length(), vr.length()};
   auto i = int(std::max_element(vs, vs+3) - vs);
 
-  auto new_head = part.heading;
+  auto new_head = head;
   auto len = vs[i];
   const auto dt = config.dt();
 
-  if (i != 0) {
-    float left_sgn = part.right_only ? 0.0f : 1.0f;
-    float sgn = i == 1 ? left_sgn : -1.0f;
-    new_head += sgn * part.turn_speed * dt;
+  if (i == 2 || (i == 1 && !parts.right_only[pi])) {
+    const float s = i == 1 ? parts.turn_sin[pi] : -parts.turn_sin[pi];
+    new_head = rotate(head, parts.turn_cos[pi], s);
   }
 
 #if 1
-  if (dir_im.theta) {
-    float px = clamp(part.position.x, 0.0f, 1.0f);
-    float py = clamp(part.position.y, 0.0f, 1.0f);
+  if (dir_im.direction) {
+    float px = clamp(position.x, 0.0f, 1.0f);
+    float py = clamp(position.y, 0.0f, 1.0f);
     int di = std::max(0, std::min(int(float(dir_im.h) * py), dir_im.h-1));
     int dj = std::max(0, std::min(int(float(dir_im.w) * px), dir_im.w-1));
-    const float dir_im_dir = dir_im.theta[ij_to_linear(di, dj, dir_im.w, 1)];
+    const Vec2f dir_im_dir = dir_im.direction[ij_to_linear(di, dj, dir_im.w, 1)];
     new_head = lerp(config.direction_influencing_image_scale, new_head, dir_im_dir);
   }
 #else
   (void) dir_im;
 #endif
 
-  auto speed_sens = 1.0f - std::exp(-len * part.sensor_speed_sensitivity);
-  auto speed = part.speed + part.sensor_speed_sensitivity_scale * speed_sens;
+  //  Keeps rounding in the rotations from accumulating, and undoes the shortening from the lerp.
+  if (const float len2 = new_head.length_squared(); len2 > 1e-12f) {
+    new_head = new_head / std::sqrt(len2);
+  } else {
+    new_head = head;
+  }
 
-  auto new_pos = part.position + to_vec(new_head) * speed * dt;
+  auto speed_sens = 1.0f - std::exp(-len * parts.sensor_speed_sensitivity[pi]);
+  auto speed = parts.speed[pi] + parts.sensor_speed_sensitivity_scale[pi] * speed_sens;
+
+  auto new_pos = position + new_head * speed * dt;
   if (config.circular_world) {
     new_pos = wrap01(new_pos);
   } else if (new_pos.x < 0.0f || new_pos.y < 0.0f || new_pos.x >= 1.0f || new_pos.y >= 1.0f) {
     const float eps = 0.001f;
     new_pos = clamp_each(new_pos, Vec2f{eps}, Vec2f{1.0f-eps});
-    new_head = urandf() * 2.0f * pif();
+    CounterRng rng(config.seed, BounceHeading, bounce_index(pi), step);
+    new_head = to_vec(rng.urandf() * 2.0f * pif());
+  }
+
+  parts.heading_x[pi] = new_head.x;
+  parts.heading_y[pi] = new_head.y;
+  parts.position_x[pi] = new_pos.x;
+  parts.position_y[pi] = new_pos.y;
+}
+
+#if SM_SIMD_ENABLED
+
+struct SimdVec3 {
+  simd::F32 x;
+  simd::F32 y;
+  simd::F32 z;
+};
+
+SimdVec3 gather_texels(const float* data, simd::I32 off, simd::Mask m) {
+  SimdVec3 res;
+  simd::gather3(data, off, m, &res.x, &res.y, &res.z);
+  return res;
+}
+
+simd::F32 half_to_float(simd::I32 h) {
+  using namespace simd;
+  const F32 mag = as_float(shl<13>(h & set1i(0x7fff))) * set1(0x1p112f);
+  return as_float(as_int(mag) | shl<16>(h & set1i(0x8000)));
+}
+
+SimdVec3 gather_texels(const Half* data, simd::I32 off, simd::Mask m) {
+  simd::I32 r, g, b;
+  simd::gather3(reinterpret_cast<const uint16_t*>(data), off, m, &r, &g, &b);
+  return {half_to_float(r), half_to_float(g), half_to_float(b)};
+}
+
+//  Not scaled to [0, 1]; see `texel_scale`.
+SimdVec3 gather_texels(const Unorm16* data, simd::I32 off, simd::Mask m) {
+  simd::I32 r, g, b;
+  simd::gather3(reinterpret_cast<const uint16_t*>(data), off, m, &r, &g, &b);
+  return {simd::to_float(r), simd::to_float(g), simd::to_float(b)};
+}
+
+template <typename T>
+constexpr float texel_scale() {
+  return std::is_same_v<T, Unorm16> ? 1.0f / 65535.0f : 1.0f;
+}
+
+//  Element offsets of texels (i, j).
+template <typename View>
+simd::I32 texel_offsets(const View& data, simd::I32 i, simd::I32 j) {
+  using namespace simd;
+  if constexpr (requires { data.stride; }) {
+    return shl<2>((j - set1i(data.y0)) * set1i(data.stride) + (i - set1i(data.x0)));
+  } else {
+    return shl<2>(j * set1i(data.width) + i);
+  }
+}
+
+/*
+ * Vectorized counterpart of `sense`. Each lane's window is walked in the same order as the scalar
+ * version, with out-of-range cells masked to zero, so for float maps per-lane sums match it
+ * exactly.
+ */
+template <typename View>
+SimdVec3 sense_simd(View data, simd::F32 px, simd::F32 py, simd::F32 win_size) {
+  using namespace simd;
+  using T = map_element_t<View>;
+  const F32 w = set1(float(data.width));
+  const F32 h = set1(float(data.height));
+  const F32 half = win_size * set1(0.5f);
+
+  const I32 i0 = to_int(floor((px - half) * w));
+  const I32 j0 = to_int(floor((py - half) * h));
+  const I32 i1 = to_int(floor((px + half) * w));
+  const I32 j1 = to_int(floor((py + half) * h));
+  const int ni = hmax(i1 - i0) + 1;
+  const int nj = hmax(j1 - j0) + 1;
+
+  const I32 zero = set1i(0);
+  const I32 width_i = set1i(data.width);
+  const I32 height_i = set1i(data.height);
+  SimdVec3 result{set1(0.0f), set1(0.0f), set1(0.0f)};
+
+  for (int di = 0; di < ni; di++) {
+    const I32 i = i0 + set1i(di);
+    const Mask mi = ((i >= zero) & (i < width_i)) & and_not(eq(i, i), i1 < i);
+    for (int dj = 0; dj < nj; dj++) {
+      const I32 j = j0 + set1i(dj);
+      const Mask m = mi & ((j >= zero) & (j < height_i)) & and_not(eq(j, j), j1 < j);
+      if (!any(m)) {
+        continue;
+      }
+      const SimdVec3 v = gather_texels(data.data, texel_offsets(data, i, j), m);
+      result.x = result.x + v.x;
+      result.y = result.y + v.y;
+      result.z = result.z + v.z;
+    }
+  }
+
+  if constexpr (texel_scale<T>() != 1.0f) {
+    const F32 scale = set1(texel_scale<T>());
+    result = {result.x * scale, result.y * scale, result.z * scale};
+  }
+
+  return result;
+}
+
+//  Table lookups are scattered doubles, so they are done per lane.
+SimdVec3 sense_sat_lanes(const SummedAreaTable& sat, simd::F32 px, simd::F32 py, simd::F32 size) {
+  using namespace simd;
+  alignas(32) float xs[width];
+  alignas(32) float ys[width];
+  alignas(32) float ss[width];
+  alignas(32) float r[width];
+  alignas(32) float g[width];
+  alignas(32) float b[width];
+  store(xs, px);
+  store(ys, py);
+  store(ss, size);
+  for (int i = 0; i < width; i++) {
+    auto v = sense_sat(sat, Vec2f{xs[i], ys[i]}, ss[i]);
+    r[i] = v.x;
+    g[i] = v.y;
+    b[i] = v.z;
   }
+  return {load(r), load(g), load(b)};
+}
 
-  part.heading = new_head;
-  part.position = new_pos;
+simd::F32 weighted_length(const SimdVec3& v, const SimdVec3& w) {
+  using namespace simd;
+  F32 x = v.x * w.x;
+  F32 y = v.y * w.y;
+  F32 z = v.z * w.z;
+  return sqrt(x * x + y * y + z * z);
+}
+
+/*
+ * Updates particles [begin, end) `simd::width` at a time and returns the index of the first
+ * particle it did not process; the remainder is left to the scalar `update_particle`.
+ */
+template <typename View>
+int update_particles_simd(
+  const Config& config, SlimeParticles& parts, int begin, int end, View im,
+  const SummedAreaTable* sat, const DirectionInfluencingImage& dir_im, uint32_t step,
+  BounceIndex bounce_index) {
+  //
+  using namespace simd;
+  constexpr int nc = Config::num_texture_channels;
+
+  const F32 dt = set1(config.dt());
+  const F32 zero = set1(0.0f);
+  const F32 one = set1(1.0f);
+  const auto* cw = reinterpret_cast<const float*>(parts.channel_weights.get());
+
+  int pi = begin;
+  for (; pi + width <= end; pi += width) {
+    const F32 px = load(parts.position_x.get() + pi);
+    const F32 py = load(parts.position_y.get() + pi);
+    const F32 hx = load(parts.heading_x.get() + pi);
+    const F32 hy = load(parts.heading_y.get() + pi);
+    const F32 lx = load(parts.left_sensor_x.get() + pi);
+    const F32 ly = load(parts.left_sensor_y.get() + pi);
+    const F32 rx = load(parts.right_sensor_x.get() + pi);
+    const F32 ry = load(parts.right_sensor_y.get() + pi);
+    const F32 step_size = load(parts.sensor_step_size.get() + pi);
+    const F32 size = load(parts.sensor_size.get() + pi);
+
+    SimdVec3 weights;
+    const I32 cwi = iota(pi) * set1i(nc);
+    gather3(cw, cwi, eq(cwi, cwi), &weights.x, &weights.y, &weights.z);
+
+    auto sense_at = [&](F32 x, F32 y) {
+      return sat ? sense_sat_lanes(*sat, x, y, size) : sense_simd(im, x, y, size);
+    };
+    const F32 lf = weighted_length(sense_at(px + hx * step_size, py + hy * step_size), weights);
+    const F32 ll = weighted_length(sense_at(px + lx * step_size, py + ly * step_size), weights);
+    const F32 lr = weighted_length(sense_at(px + rx * step_size, py + ry * step_size), weights);
+
+    //  Same tie-breaking as std::max_element over {forward, left, right}.
+    const Mask is_f = (lf >= ll) & (lf >= lr);
+    const Mask is_l = and_not(ll >= lr, is_f);
+    const F32 len = select(is_f, lf, select(is_l, ll, lr));
+
+    alignas(32) float right_only[width];
+    for (int i = 0; i < width; i++) {
+      right_only[i] = parts.right_only[pi + i] ? 1.0f : 0.0f;
+    }
+    //  Rotate by +turn (left), -turn (right) or not at all.
+    const Mask no_turn = is_f | (is_l & (set1(0.5f) < load(right_only)));
+    const F32 ts = load(parts.turn_sin.get() + pi);
+    const F32 tc = select(no_turn, one, load(parts.turn_cos.get() + pi));
+    const F32 tsgn = select(no_turn, zero, select(is_l, ts, -ts));
+    F32 nx = hx * tc - hy * tsgn;
+    F32 ny = hx * tsgn + hy * tc;
+
+    if (dir_im.direction) {
+      const F32 cx = min(max(px, zero), one);
+      const F32 cy = min(max(py, zero), one);
+      const I32 di = to_int(min(set1(float(dir_im.h)) * cy, set1(float(dir_im.h - 1))));
+      const I32 dj = to_int(min(set1(float(dir_im.w)) * cx, set1(float(dir_im.w - 1))));
+      const I32 off = shl<1>(di * set1i(dir_im.w) + dj);
+      const auto* dirs = reinterpret_cast<const float*>(dir_im.direction.get());
+      const F32 s = set1(config.direction_influencing_image_scale);
+      nx = (one - s) * nx + s * gather(dirs, off);
+      ny = (one - s) * ny + s * gather(dirs + 1, off);
+    }
+
+    const F32 len2 = nx * nx + ny * ny;
+    const Mask keep = set1(1e-12f) < len2;
+    const F32 inv_len = one / sqrt(select(keep, len2, one));
+    nx = select(keep, nx * inv_len, hx);
+    ny = select(keep, ny * inv_len, hy);
+
+    const F32 sens = load(parts.sensor_speed_sensitivity.get() + pi);
+    const F32 speed_sens = one - exp(-len * sens);
+    const F32 speed = load(parts.speed.get() + pi) +
+      load(parts.sensor_speed_sensitivity_scale.get() + pi) * speed_sens;
+
+    F32 x = px + nx * speed * dt;
+    F32 y = py + ny * speed * dt;
+
+    store(parts.heading_x.get() + pi, nx);
+    store(parts.heading_y.get() + pi, ny);
+    if (config.circular_world) {
+      x = x - floor(x);
+      y = y - floor(y);
+      x = select(one <= x, zero, x);
+      y = select(one <= y, zero, y);
+    } else {
+      const Mask out = (x < zero) | (y < zero) | (one <= x) | (one <= y);
+      const F32 eps = set1(0.001f);
+      x = min(max(x, eps), one - eps);
+      y = min(max(y, eps), one - eps);
+      if (const int out_bits = bits(out)) {
+        for (int i = 0; i < width; i++) {
+          if (out_bits & (1 << i)) {
+            CounterRng rng(config.seed, BounceHeading, bounce_index(pi + i), step);
+            const auto h = to_vec(rng.urandf() * 2.0f * pif());
+            parts.heading_x[pi + i] = h.x;
+            parts.heading_y[pi + i] = h.y;
+          }
+        }
+      }
+    }
+
+    store(parts.position_x.get() + pi, x);
+    store(parts.position_y.get() + pi, y);
+  }
+
+  return pi;
+}
+
+#endif
+
+template <typename View>
+void update_particles(
+  const Config& config, SlimeParticles& parts, int begin, int end, View im,
+  const SummedAreaTable* sat, const DirectionInfluencingImage& dir_im, uint32_t step,
+  BounceIndex bounce_index = {0, 1}) {
+  //
+  int i = begin;
+#if SM_SIMD_ENABLED
+  if (config.simd_update_enabled) {
+    i = update_particles_simd(config, parts, begin, end, im, sat, dir_im, step, bounce_index);
+  }
+#endif
+  for (; i < end; i++) {
+    update_particle(config, parts, i, im, sat, dir_im, step, bounce_index);
+  }
+}
+
+template <typename View>
+void deposit_particles(
+  const SlimeParticles& parts, int begin, int end, View data, TileMarks marks = {}) {
+  //
+  for (int i = begin; i < end; i++) {
+    deposit(parts, i, data, marks);
+  }
+}
+
+int particle_chunk_size(int num_particles, int num_chunks) {
+  int chunk = (num_particles + num_chunks - 1) / num_chunks;
+#if SM_SIMD_ENABLED
+  //  keep chunk boundaries on vector boundaries, so only the last chunk has a scalar tail
+  chunk = ((chunk + simd::width - 1) / simd::width) * simd::width;
+#endif
+  return std::max(1, chunk);
+}
+
+template <typename View>
+void update_particles_parallel(
+  ThreadPool& pool, const Config& config, SlimeParticles& parts, View im,
+  const SummedAreaTable* sat, const DirectionInfluencingImage& dir_im, uint32_t step) {
+  //
+  const int num_particles = parts.size();
+  const int num_chunks = pool.num_threads() * 4;
+  const int chunk = particle_chunk_size(num_particles, num_chunks);
+  pool.parallel_for(num_chunks, [&](int c) {
+    const int begin = std::min(num_particles, c * chunk);
+    const int end = std::min(num_particles, begin + chunk);
+    update_particles(config, parts, begin, end, im, sat, dir_im, step);
+  });
+}
+
+/*
+ * Deposit in parallel without write conflicts: the map is split into horizontal bands, particles
+ * are binned by the band they deposit into (a stable counting sort, done in parallel over chunks
+ * of particles), and then each band is deposited by exactly one task. Within a band particles are
+ * visited in their original order, so the result is identical to the serial loop. Active tiles
+ * are one row tall, so bands mark them without conflicts too.
+ */
+template <typename View>
+void deposit_particles_parallel(
+  ThreadPool& pool, const SlimeParticles& parts, View data,
+  SlimeMoldSimulationWorkspace& ws, TileMarks marks = {}) {
+  //
+  const int td = data.height;
+  const int num_particles = parts.size();
+  const int num_chunks = pool.num_threads() * 4;
+  const int chunk = particle_chunk_size(num_particles, num_chunks);
+
+  const int band_height = std::max(1, (td + num_chunks - 1) / num_chunks);
+  const int num_bands = (td + band_height - 1) / band_height;
+
+  auto band_of = [&](int i) {
+    const int j = int(std::floor(parts.position_y[i] * float(td)));
+    return clamp(j / band_height, 0, num_bands - 1);
+  };
+
+  ws.particle_order.resize(num_particles);
+  ws.band_counts.assign(num_chunks * num_bands, 0);
+  ws.band_offsets.resize(num_bands + 1);
+  int* counts = ws.band_counts.data();
+  int* order = ws.particle_order.data();
+
+  pool.parallel_for(num_chunks, [&](int c) {
+    const int begin = std::min(num_particles, c * chunk);
+    const int end = std::min(num_particles, begin + chunk);
+    int* chunk_counts = counts + c * num_bands;
+    for (int i = begin; i < end; i++) {
+      chunk_counts[band_of(i)]++;
+    }
+  });
+
+  int off{};
+  for (int b = 0; b < num_bands; b++) {
+    ws.band_offsets[b] = off;
+    for (int c = 0; c < num_chunks; c++) {
+      const int ct = counts[c * num_bands + b];
+      counts[c * num_bands + b] = off;
+      off += ct;
+    }
+  }
+  ws.band_offsets[num_bands] = off;
+
+  pool.parallel_for(num_chunks, [&](int c) {
+    const int begin = std::min(num_particles, c * chunk);
+    const int end = std::min(num_particles, begin + chunk);
+    int* chunk_offsets = counts + c * num_bands;
+    for (int i = begin; i < end; i++) {
+      order[chunk_offsets[band_of(i)]++] = i;
+    }
+  });
+
+  pool.parallel_for(num_bands, [&](int b) {
+    for (int k = ws.band_offsets[b]; k < ws.band_offsets[b + 1]; k++) {
+      deposit(parts, order[k], data, marks);
+    }
+  });
 }
 
 float power_to_scale(int current, int desired) {
@@ -340,267 +980,1401 @@ float power_to_scale(int current, int desired) {
   return scale;
 }
 
-template <int N>
-void box_filter(const float* a, float* out, float* tmp, int r, int c, int k_size) {
-  simple_box_filter<float, N>(a, out, tmp, r, c, k_size);
+template <typename T>
+void set_perturb_data(
+  const Config& config, MapView<const T> im, MapView<T> out, uint32_t step, ThreadPool* pool) {
+  //
+  if (config.perturb_event_type == 1) {
+    auto noise_data = make_texture_data(out.width, out.height);
+    auto tmp_data = make_texture_data(out.width, out.height);
+    MapView<float> noise{noise_data.get(), out.width, out.height};
+    set_random_data(noise, config.seed, step, pool);
+    box_filter(noise, noise, MapView<float>{tmp_data.get(), out.width, out.height}, 5);
+
+    for (int y = 0; y < out.height; y++) {
+      for (int x = 0; x < out.width; x++) {
+        const T* src = im.texel(x, y);
+        const float* n = noise.texel(x, y);
+        T* dst = out.texel(x, y);
+        for (int k = 0; k < out.color_channels; k++) {
+          const float v = (1.0f - to_float(src[k])) * std::min(1.0f, std::pow(n[k], 8.0f) * 2.0f);
+          dst[k] = from_float<T>(v);
+        }
+      }
+    }
+  } else {
+    std::fill(out.data, out.data + out.size(), from_float<T>(0.0f));
+    CounterRng rng(config.seed, PerturbCircles, 0, step);
+    for (int i = 0; i < config.num_perturb_circles; i++) {
+      Vec2f center{rng.urandf(), rng.urandf()};
+      const auto r = 0.1f;
+      auto add = Vec3f{rng.urandf(), rng.urandf(), rng.urandf()} * 0.5f;
+      add[rng.uniform_int(3)] = rng.urandf() * 0.25f + 0.75f;
+      float add_array[3] = {add.x, add.y, add.z};
+      clamped_add(out, center, r, add_array);
+    }
+  }
 }
 
-template <typename Op>
-void component_wise(Op&& op, int r, int c, int nc) {
-  for (int i = 0; i < r * c * nc; i++) {
-    op(i);
+struct PixelRect {
+  bool empty() const {
+    return i1 < i0 || j1 < j0;
   }
+
+  int i0;
+  int j0;
+  int i1; //  inclusive
+  int j1;
+};
+
+//  Region of the map touched by `set_signal_data`.
+PixelRect signal_bounds(const gen::SlimeMoldParams& params, int r, int c) {
+  const auto& p = params.signal_position;
+  const auto radius = params.signal_radius;
+  auto [i0, j0] = to_ij(p - radius, r, c);
+  auto [i1, j1] = to_ij(p + radius, r, c);
+  return {std::max(0, i0), std::max(0, j0), std::min(c - 1, i1), std::min(r - 1, j1)};
 }
 
-template <typename Op>
-void component_wise(Op&& op) {
-  const auto td = Config::texture_dim;
-  const auto nc = Config::num_texture_channels;
-  component_wise(op, td, td, nc);
+bool same_signal_params(const gen::SlimeMoldParams& a, const gen::SlimeMoldParams& b) {
+  return a.signal_value == b.signal_value &&
+         a.signal_position == b.signal_position &&
+         a.signal_radius == b.signal_radius &&
+         a.channel_mask == b.channel_mask;
 }
 
-void im_lerp(const float* a, const float* b, float* out, float t) {
-  component_wise([t, a, b, out](int off) {
-    out[off] = lerp(t, a[off], b[off]);
-  });
+template <typename T>
+void set_signal_data(MapView<T> im, const gen::SlimeMoldParams& params) {
+  std::fill(im.data, im.data + im.size(), from_float<T>(0.0f));
+  auto add = params.channel_mask * params.signal_value;
+  float add_array[3] = {add.x, add.y, add.z};
+  clamped_add(im, params.signal_position, params.signal_radius, add_array);
 }
 
-void im_decay(const float* a, float* out, float decay) {
-  component_wise([a, out, decay](int off) {
-    out[off] = std::max(0.0f, a[off] - decay);
-  });
+/*
+ * Fused post-deposit pass. Every stage that is enabled is applied to a row while it is in cache,
+ * in the same order the stages used to run as separate full-map passes:
+ *
+ *  diffuse (box filter, lerp toward the filtered map, decay) -> signal -> perturb -> average
+ *    -> RGBA8 pack
+ *
+ * The map is processed in horizontal bands of a fixed height. Each band pre-filters the rows
+ * just outside it (its halo) before any band writes, so bands can run concurrently, and because
+ * band boundaries only depend on the filter size, results do not depend on the thread count.
+ * Maps with reduced-precision storage are widened one row at a time.
+ *
+ * With active tiles, each band only visits the span of columns the pass can change in it, and
+ * bands without one are skipped; every texel outside the spans is zero and stays zero, so the
+ * result is the same.
+ */
+template <typename T>
+struct PostStepPass {
+  bool diffuse;
+  int filter_size;
+  float diffuse_speed;
+  float decay;
+  MapView<const T> signal_data;  //  optional
+  PixelRect signal_rect;
+  MapView<const T> perturb_data;  //  optional
+  bool average;
+  uint8_t* rgbau8_data;  //  optional
+  //  Texels packed into `rgbau8_data`: texel (i0, j0) to its first pixel, rows `rgbau8_stride`
+  //  pixels apart.
+  PixelRect rgbau8_rect;
+  int rgbau8_stride;
+  ImageDirtyRegion* rgbau8_dirty;  //  optional
+  SlimeMoldActiveTiles* active;  //  optional; bound to the map
+};
+
+enum PostStepStage {
+  PostStepDiffuse,  //  also loading and storing map rows
+  PostStepSignal,
+  PostStepPerturb,
+  PostStepAverage,
+  PostStepPack,
+  NumPostStepStages
+};
+
+//  Wall time per stage, in ms, accumulated over post-step passes.
+struct PostStepStageTimes {
+  float ms[NumPostStepStages];
+};
+
+//  Adds the time since the previous lap to a stage's total, in seconds; a no-op without totals.
+class StageLaps {
+public:
+  explicit StageLaps(double* totals) : totals{totals} {
+    if (totals) {
+      last = std::chrono::high_resolution_clock::now();
+    }
+  }
+
+  void lap(int stage) {
+    if (totals) {
+      const auto now = std::chrono::high_resolution_clock::now();
+      totals[stage] += std::chrono::duration<double>(now - last).count();
+      last = now;
+    }
+  }
+
+private:
+  double* totals;
+  std::chrono::high_resolution_clock::time_point last;
+};
+
+struct PostStepBands {
+  int height;
+  int count;
+  int head_rows;  //  halo rows above a band
+  int tail_rows;  //  halo rows below a band
+  int row_size;
+  int band_scratch_size;
+};
+
+template <typename T>
+PostStepBands post_step_bands(const PostStepPass<T>& pass, int r, int c) {
+  constexpr int nc = MapView<T>::channels;
+  const int k = pass.diffuse ? pass.filter_size : 1;
+  PostStepBands res{};
+  res.height = std::min(r, std::max(64, 4 * k));
+  res.count = (r + res.height - 1) / res.height;
+  res.head_rows = k / 2;
+  res.tail_rows = k - 1 - k / 2;
+  res.row_size = c * nc;
+  //  head halo, tail halo, ring of k filtered rows, widened row
+  res.band_scratch_size = (res.head_rows + res.tail_rows + k + 1) * res.row_size;
+  return res;
 }
 
-void diffuse(float* a, float* b, float* tmp, float decay, float diff_speed, int filter_size) {
-  constexpr auto nc = Config::num_texture_channels;
-  box_filter<nc>(a, b, tmp, Config::texture_dim, Config::texture_dim, filter_size);
-  im_lerp(a, b, a, diff_speed);
-  im_decay(a, a, decay);
+//  Horizontal box filter of a map row, widened through `tmp` first if needed.
+template <typename T>
+void filter_map_row(const T* src, float* dst, float* tmp, int c, int k_size) {
+  constexpr int nc = MapView<T>::channels;
+  if constexpr (std::is_same_v<T, float>) {
+    (void) tmp;
+    box_filter_row<float, nc>(src, dst, c, k_size);
+  } else {
+    widen(src, tmp, c * nc);
+    box_filter_row<float, nc>(tmp, dst, c, k_size);
+  }
 }
 
-void set_perturb_data(const Config& config, const float* im, float* out) {
-#if DYNAMIC_TEXTURE_SIZE
-  const auto dim = Config::texture_dim;
-#else
-  constexpr auto dim = Config::texture_dim;
-#endif
-  constexpr auto nc = Config::num_texture_channels;
-  static_assert(nc == 3);
+//  Texels [x0, x1) of row `j`, starting at `row`, of a map `c` texels wide.
+template <typename T>
+void finish_row(
+  const PostStepPass<T>& pass, float* row, int j, int x0, int x1, StageLaps& laps) {
+  //
+  constexpr int nc = MapView<T>::channels;
+  constexpr int ncc = MapView<T>::color_channels;
+  const int n = (x1 - x0) * nc;
+
+  const auto& sr = pass.signal_rect;
+  if (pass.signal_data.data && !sr.empty() && j >= sr.j0 && j <= sr.j1) {
+    const T* signal = pass.signal_data.row(j) + x0 * nc;
+    for (int k = (std::max(sr.i0, x0) - x0) * nc; k < (std::min(sr.i1 + 1, x1) - x0) * nc; k++) {
+      row[k] = std::max(to_float(signal[k]), row[k]);
+    }
+    laps.lap(PostStepSignal);
+  }
 
-  if (config.perturb_event_type == 1) {
-    set_random_data(out, dim, dim, nc);
+  if (pass.perturb_data.data) {
+    const T* perturb = pass.perturb_data.row(j) + x0 * nc;
+    for (int k = 0; k < n; k++) {
+      row[k] = std::min(1.0f, row[k] + to_float(perturb[k]));
+    }
+    laps.lap(PostStepPerturb);
+  }
 
-    auto tmp0 = make_texture_data();
-    auto tmp1 = make_texture_data();
-    box_filter<nc>(out, tmp0.get(), tmp1.get(), dim, dim, 5);
-    std::copy(tmp0.get(), tmp0.get() + data_texture_size(), out);
+  if (pass.average) {
+    for (int i = 0; i < x1 - x0; i++) {
+      float mu{};
+      for (int k = 0; k < ncc; k++) {
+        mu += clamp(row[i * nc + k], 0.0f, 1.0f);
+      }
+      mu /= 3.0f;
+      for (int k = 0; k < ncc; k++) {
+        row[i * nc + k] = mu;
+      }
+    }
+    laps.lap(PostStepAverage);
+  }
 
-    component_wise([out, im](int off) {
-      out[off] = (1.0f - im[off]) * std::min(1.0f, std::pow(out[off], 8.0f) * 2.0f);
-    });
-  } else {
-    std::fill(out, out + data_texture_size(), 0.0f);
-    for (int i = 0; i < config.num_perturb_circles; i++) {
-      Vec2f center{urandf(), urandf()};
-      const auto r = 0.1f;
-      auto add = Vec3f{urandf(), urandf(), urandf()} * 0.5f;
-      add[int(urand() * 3.0)] = urandf() * 0.25f + 0.75f;
-      float add_array[3] = {add.x, add.y, add.z};
-      clamped_add(out, dim, dim, nc, center, r, add_array);
+  //  Map texels and RGBA8 pixels have the same shape; the padding channel packs to alpha 0.
+  const auto& pr = pass.rgbau8_rect;
+  if (pass.rgbau8_data && j >= pr.j0 && j <= pr.j1) {
+    const int px0 = std::max(pr.i0, x0);
+    const int px1 = std::min(pr.i1 + 1, x1);
+    uint8_t* dst = pass.rgbau8_data + ((j - pr.j0) * pass.rgbau8_stride + px0 - pr.i0) * 4;
+    for (int k = 0; k < (px1 - px0) * nc; k++) {
+      dst[k] = uint8_t(clamp(row[(px0 - x0) * nc + k], 0.0f, 1.0f) * 255.0f);
     }
+    laps.lap(PostStepPack);
   }
 }
 
-void apply_perturb(const float* perturb, float* out) {
-  component_wise([perturb, out](int off) {
-    out[off] = std::min(1.0f, out[off] + perturb[off]);
-  });
+//  Sets the active tiles of row `j` over texels [x0, x1), starting at `row`, from their final
+//  values, and clears the rest of those tiles; texels of theirs outside the span are zero.
+template <typename T>
+void mark_row(const PostStepPass<T>& pass, const float* row, int j, int x0, int x1) {
+  constexpr int nc = MapView<T>::channels;
+  constexpr int tw = SlimeMoldActiveTiles::tile_width;
+  if (!pass.active) {
+    return;
+  }
+  uint8_t* bits = pass.active->active.data() + j * pass.active->tiles_x;
+  for (int x = x0; x < x1;) {
+    const int end = std::min(x1, (x / tw + 1) * tw);
+    bool any{};
+    for (int k = (x - x0) * nc; k < (end - x0) * nc; k++) {
+      any |= row[k] > 0.0f;
+    }
+    bits[x / tw] = any;
+    x = end;
+  }
 }
 
-void apply_signal(const float* signal, float* out) {
-  component_wise([signal, out](int off) {
-    out[off] = std::max(signal[off], out[off]);
-  });
+/*
+ * Columns [x0, x1) of band `b` the pass can change: those within the filter's reach of an active
+ * tile in the band or its halo rows, and those the signal and perturb maps add to. Empty if
+ * x1 <= x0. Without active tiles, the whole width.
+ */
+template <typename T>
+std::pair<int, int> band_span(
+  const PostStepPass<T>& pass, const PostStepBands& bands, int b, int r, int c) {
+  //
+  constexpr int tw = SlimeMoldActiveTiles::tile_width;
+  if (!pass.active) {
+    return {0, c};
+  }
+  const auto& tiles = *pass.active;
+  const int y0 = b * bands.height;
+  const int y1 = std::min(r, y0 + bands.height);
+
+  int x0{c};
+  int x1{};
+  auto add_tiles = [&](const uint8_t* bits, int row0, int row1, int left, int right) {
+    for (int j = std::max(0, row0); j < std::min(r, row1); j++) {
+      const uint8_t* row = bits + j * tiles.tiles_x;
+      for (int tx = 0; tx < tiles.tiles_x; tx++) {
+        if (row[tx]) {
+          x0 = std::min(x0, tx * tw - left);
+          x1 = std::max(x1, (tx + 1) * tw + right);
+        }
+      }
+    }
+  };
+
+  //  A texel reaches tail_rows columns to its left after filtering, and head_rows to its right.
+  add_tiles(
+    tiles.active.data(), y0 - bands.head_rows, y1 + bands.tail_rows,
+    bands.tail_rows, bands.head_rows);
+  if (pass.perturb_data.data) {
+    if (tiles.perturb.empty()) {
+      return {0, c};
+    }
+    add_tiles(tiles.perturb.data(), y0, y1, 0, 0);
+  }
+  if (pass.rgbau8_data && !tiles.unpacked.empty()) {
+    add_tiles(tiles.unpacked.data(), y0, y1, 0, 0);
+  }
+  const auto& sr = pass.signal_rect;
+  if (pass.signal_data.data && !sr.empty() && sr.j0 < y1 && sr.j1 >= y0) {
+    x0 = std::min(x0, sr.i0);
+    x1 = std::max(x1, sr.i1 + 1);
+  }
+  return {std::max(0, x0), std::min(c, x1)};
 }
 
-void set_signal_data(float* im, const gen::SlimeMoldParams& params) {
-#if DYNAMIC_TEXTURE_SIZE
-  const auto dim = Config::texture_dim;
-#else
-  constexpr auto dim = Config::texture_dim;
-#endif
-  constexpr auto nc = Config::num_texture_channels;
-  static_assert(nc == 3);
+template <typename T>
+void prepare_band_halo(
+  const PostStepPass<T>& pass, const PostStepBands& bands, MapView<const T> data, int b,
+  int x0, int x1, float* scratch) {
+  //
+  constexpr int nc = MapView<T>::channels;
+  const int r = data.height;
+  const int y0 = b * bands.height;
+  const int y1 = std::min(r, y0 + bands.height);
+  float* head = scratch;
+  float* tail = head + bands.head_rows * bands.row_size;
+  float* row_buf = scratch + bands.band_scratch_size - bands.row_size;
+  for (int row = std::max(0, y0 - bands.head_rows); row < y0; row++) {
+    float* dst = head + (row - (y0 - bands.head_rows)) * bands.row_size;
+    filter_map_row(data.row(row) + x0 * nc, dst, row_buf, x1 - x0, pass.filter_size);
+  }
+  for (int row = y1; row < std::min(r, y1 + bands.tail_rows); row++) {
+    float* dst = tail + (row - y1) * bands.row_size;
+    filter_map_row(data.row(row) + x0 * nc, dst, row_buf, x1 - x0, pass.filter_size);
+  }
+}
 
-  std::fill(im, im + data_texture_size(), 0.0f);
-  auto add = params.channel_mask * params.signal_value;
-  float add_array[3] = {add.x, add.y, add.z};
-  clamped_add(im, dim, dim, nc, params.signal_position, params.signal_radius, add_array);
+template <typename T>
+void post_step_band(
+  const PostStepPass<T>& pass, const PostStepBands& bands, MapView<T> data, int b,
+  int x0, int x1, float* scratch, double* col_sum, double* stage_s) {
+  //
+  constexpr int nc = MapView<T>::channels;
+  const int r = data.height;
+  //  Rows of scratch are a full map row apart; only the span is used.
+  const int row_size = bands.row_size;
+  const int n = (x1 - x0) * nc;
+  const int y0 = b * bands.height;
+  const int y1 = std::min(r, y0 + bands.height);
+  float* row_buf = scratch + bands.band_scratch_size - row_size;
+  StageLaps laps{stage_s};
+
+  //  The span of row `j` as float, and back.
+  auto load_row = [&](int j) -> float* {
+    if constexpr (std::is_same_v<T, float>) {
+      return data.row(j) + x0 * nc;
+    } else {
+      widen(data.row(j) + x0 * nc, row_buf, n);
+      return row_buf;
+    }
+  };
+  auto store_row = [&](int j, const float* row) {
+    if constexpr (!std::is_same_v<T, float>) {
+      narrow(row, data.row(j) + x0 * nc, n);
+    } else {
+      (void) j;
+      (void) row;
+    }
+  };
+
+  if (!pass.diffuse) {
+    for (int j = y0; j < y1; j++) {
+      float* row = load_row(j);
+      laps.lap(PostStepDiffuse);
+      finish_row(pass, row, j, x0, x1, laps);
+      mark_row(pass, row, j, x0, x1);
+      store_row(j, row);
+      laps.lap(PostStepDiffuse);
+    }
+    return;
+  }
+
+  const int k = pass.filter_size;
+  const int k2 = bands.head_rows;
+  const int kt = bands.tail_rows;
+  const float v = 1.0f / float(k);
+  const float* head = scratch;
+  const float* tail = head + k2 * row_size;
+  float* ring = scratch + (k2 + kt) * row_size;
+
+  //  Filtered row `row`, for rows in the current window. Rows inside the band are filtered into
+  //  the ring when they enter the window, before the band overwrites them.
+  auto window_row = [&](int row) -> const float* {
+    if (row < y0) {
+      return head + (row - (y0 - k2)) * row_size;
+    } else if (row >= y1) {
+      return tail + (row - y1) * row_size;
+    } else {
+      return ring + (row % k) * row_size;
+    }
+  };
+  auto enter_window = [&](int row) {
+    if (row >= y0 && row < y1) {
+      filter_map_row(data.row(row) + x0 * nc, ring + (row % k) * row_size, row_buf, x1 - x0, k);
+    }
+    add_row(col_sum, window_row(row), n);
+  };
+
+  std::fill(col_sum, col_sum + n, 0.0);
+  for (int row = std::max(0, y0 - k2); row < std::min(r, y0 + kt); row++) {
+    enter_window(row);
+  }
+
+  for (int j = y0; j < y1; j++) {
+    if (j + kt < r) {
+      enter_window(j + kt);
+    }
+
+    float* row = load_row(j);
+    for (int i = 0; i < n; i++) {
+      const float blurred = float(col_sum[i] * v);
+      row[i] = std::max(0.0f, lerp(pass.diffuse_speed, row[i], blurred) - pass.decay);
+    }
+    laps.lap(PostStepDiffuse);
+    finish_row(pass, row, j, x0, x1, laps);
+    mark_row(pass, row, j, x0, x1);
+    store_row(j, row);
+
+    if (j - k2 >= 0) {
+      sub_row(col_sum, window_row(j - k2), n);
+    }
+    laps.lap(PostStepDiffuse);
+  }
 }
 
-void scale_turn_speed(SlimeParticle* parts, int num_parts, float scale) {
-  for (int i = 0; i < num_parts; i++) {
-    parts[i].turn_speed *= scale;
+//  Notes the tiles under each band's span as changed since the image was last packed.
+void mark_unpacked(
+  SlimeMoldActiveTiles& tiles, const PostStepBands& bands, const int* spans, int r) {
+  //
+  constexpr int tw = SlimeMoldActiveTiles::tile_width;
+  if (tiles.unpacked.empty()) {
+    tiles.unpacked.assign(size_t(r) * tiles.tiles_x, 0);
+  }
+  for (int b = 0; b < bands.count; b++) {
+    const int x0 = spans[b * 2];
+    const int x1 = spans[b * 2 + 1];
+    if (x0 >= x1) {
+      continue;
+    }
+    for (int j = b * bands.height; j < std::min(r, (b + 1) * bands.height); j++) {
+      uint8_t* row = tiles.unpacked.data() + j * tiles.tiles_x;
+      std::fill(row + x0 / tw, row + (x1 - 1) / tw + 1, uint8_t(1));
+    }
   }
 }
 
-void scale_speed(SlimeParticle* parts, int num_parts, float scale) {
-  for (int i = 0; i < num_parts; i++) {
-    parts[i].speed *= scale;
+/*
+ * With `times`, each band totals the time it spends in each stage, and the wall time of the pass
+ * is shared out in proportion to those totals, so the stages add up to the pass on any number of
+ * threads.
+ */
+template <typename T>
+void post_step(
+  const PostStepPass<T>& pass, MapView<T> data, ThreadPool* pool,
+  SlimeMoldSimulationWorkspace& ws, PostStepStageTimes* times = nullptr) {
+  //
+  const auto t0 = std::chrono::high_resolution_clock::now();
+  const auto bands = post_step_bands(pass, data.height, data.width);
+  ws.post_step_scratch.resize(size_t(bands.count) * bands.band_scratch_size);
+  ws.post_step_col_sums.resize(size_t(bands.count) * bands.row_size);
+  float* scratch = ws.post_step_scratch.data();
+  double* col_sums = ws.post_step_col_sums.data();
+  double* stage_s{};
+  if (times) {
+    ws.post_step_stage_s.assign(size_t(bands.count) * NumPostStepStages, 0.0);
+    stage_s = ws.post_step_stage_s.data();
+  }
+  auto band_stage_s = [&](int b) {
+    return stage_s ? stage_s + b * NumPostStepStages : nullptr;
+  };
+
+  //  An image the bits were not packed into has to be packed in full.
+  const bool repack = pass.active && pass.rgbau8_data && pass.active->rgbau8 != pass.rgbau8_data;
+  ws.post_step_spans.resize(size_t(bands.count) * 2);
+  int* spans = ws.post_step_spans.data();
+  for (int b = 0; b < bands.count; b++) {
+    const auto [x0, x1] = repack ?
+      std::pair<int, int>{0, data.width} : band_span(pass, bands, b, data.height, data.width);
+    spans[b * 2] = x0;
+    spans[b * 2 + 1] = x1;
+  }
+  if (pass.active && !pass.rgbau8_data) {
+    mark_unpacked(*pass.active, bands, spans, data.height);
+  }
+
+  auto prepare = [&](int b) {
+    if (spans[b * 2] >= spans[b * 2 + 1]) {
+      return;
+    }
+    StageLaps laps{band_stage_s(b)};
+    prepare_band_halo(
+      pass, bands, MapView<const T>(data), b, spans[b * 2], spans[b * 2 + 1],
+      scratch + b * bands.band_scratch_size);
+    laps.lap(PostStepDiffuse);
+  };
+  auto process = [&](int b) {
+    if (spans[b * 2] >= spans[b * 2 + 1]) {
+      return;
+    }
+    post_step_band(
+      pass, bands, data, b, spans[b * 2], spans[b * 2 + 1],
+      scratch + b * bands.band_scratch_size, col_sums + b * bands.row_size, band_stage_s(b));
+  };
+
+  if (pool && pool->num_threads() > 1) {
+    if (pass.diffuse) {
+      pool->parallel_for(bands.count, prepare);
+    }
+    pool->parallel_for(bands.count, process);
+  } else {
+    if (pass.diffuse) {
+      for (int b = 0; b < bands.count; b++) {
+        prepare(b);
+      }
+    }
+    for (int b = 0; b < bands.count; b++) {
+      process(b);
+    }
+  }
+  if (pass.active && pass.rgbau8_data) {
+    pass.active->rgbau8 = pass.rgbau8_data;
+    pass.active->unpacked.clear();
+  }
+  if (pass.rgbau8_data && pass.rgbau8_dirty) {
+    for (int b = 0; b < bands.count; b++) {
+      const int y0 = b * bands.height;
+      pass.rgbau8_dirty->add(
+        {spans[b * 2], y0, spans[b * 2 + 1], std::min(data.height, y0 + bands.height)});
+    }
+  }
+
+  if (times) {
+    double totals[NumPostStepStages]{};
+    double total{};
+    for (int b = 0; b < bands.count; b++) {
+      for (int i = 0; i < NumPostStepStages; i++) {
+        totals[i] += stage_s[b * NumPostStepStages + i];
+        total += stage_s[b * NumPostStepStages + i];
+      }
+    }
+    const double wall_ms = std::chrono::duration<double>(
+      std::chrono::high_resolution_clock::now() - t0).count() * 1e3;
+    for (int i = 0; i < NumPostStepStages && total > 0.0; i++) {
+      times->ms[i] += float(wall_ms * totals[i] / total);
+    }
   }
 }
 
-void set_right_only(SlimeParticle* parts, int num_parts, bool v) {
-  for (int i = 0; i < num_parts; i++) {
-    parts[i].right_only = v;
+void scale_turn_speed(SlimeParticles& parts, float scale) {
+  for (int i = 0; i < parts.size(); i++) {
+    parts.turn_speed[i] *= scale;
   }
+  parts.turn_rotation_dt = 0.0f;
 }
 
-} //  anon
+void scale_speed(SlimeParticles& parts, float scale) {
+  for (int i = 0; i < parts.size(); i++) {
+    parts.speed[i] *= scale;
+  }
+}
 
-std::unique_ptr<float[]> gen::make_slime_mold_texture_data() {
-  return make_texture_data();
+void set_right_only(SlimeParticles& parts, bool v) {
+  std::fill(parts.right_only.get(), parts.right_only.get() + parts.size(), v);
 }
 
-std::unique_ptr<uint8_t[]> gen::make_rgbau8_slime_mold_texture_data() {
-  return std::make_unique<uint8_t[]>(Config::texture_dim * Config::texture_dim * 4);
+//  Spreads the low 16 bits of `v` to the even bits of the result.
+uint32_t part1by1(uint32_t v) {
+  v &= 0xffffu;
+  v = (v | (v << 8)) & 0x00ff00ffu;
+  v = (v | (v << 4)) & 0x0f0f0f0fu;
+  v = (v | (v << 2)) & 0x33333333u;
+  v = (v | (v << 1)) & 0x55555555u;
+  return v;
 }
 
-DefaultSlimeMoldSimulationTextureData gen::make_default_slime_mold_texture_data() {
-  DefaultSlimeMoldSimulationTextureData result;
-  result.texture_data0 = make_slime_mold_texture_data();
-  result.texture_data1 = make_slime_mold_texture_data();
-  result.texture_data2 = make_slime_mold_texture_data();
-  result.perturb_data = make_slime_mold_texture_data();
-  result.signal_data = make_slime_mold_texture_data();
-  result.rgbau8_texture_data = make_rgbau8_slime_mold_texture_data();
+SlimeParticles make_particles(int num_particles) {
+  SlimeParticles result;
+  result.num_particles = num_particles;
+  result.position_x = std::make_unique<float[]>(num_particles);
+  result.position_y = std::make_unique<float[]>(num_particles);
+  result.heading_x = std::make_unique<float[]>(num_particles);
+  result.heading_y = std::make_unique<float[]>(num_particles);
+  result.left_sensor_x = std::make_unique<float[]>(num_particles);
+  result.left_sensor_y = std::make_unique<float[]>(num_particles);
+  result.right_sensor_x = std::make_unique<float[]>(num_particles);
+  result.right_sensor_y = std::make_unique<float[]>(num_particles);
+  result.sensor_step_size = std::make_unique<float[]>(num_particles);
+  result.sensor_size = std::make_unique<float[]>(num_particles);
+  result.speed = std::make_unique<float[]>(num_particles);
+  result.deposit = std::make_unique<float[]>(num_particles);
+  result.channel_weights = std::make_unique<Vec3f[]>(num_particles);
+  result.sensor_speed_sensitivity = std::make_unique<float[]>(num_particles);
+  result.sensor_speed_sensitivity_scale = std::make_unique<float[]>(num_particles);
+  result.turn_speed = std::make_unique<float[]>(num_particles);
+  result.right_only = std::make_unique<bool[]>(num_particles);
+  result.turn_cos = std::make_unique<float[]>(num_particles);
+  result.turn_sin = std::make_unique<float[]>(num_particles);
   return result;
 }
 
-std::unique_ptr<SlimeParticle[]> gen::make_slime_mold_particles(const SlimeMoldConfig& config) {
-  auto result = std::make_unique<SlimeParticle[]>(config.num_particles);
-  for (int i = 0; i < config.num_particles; i++) {
-    auto pos = Vec2f{urand_11f(), urand_11f()} * Config::starting_offset_span + 0.5f;
-    auto head = urandf() * 2.0f * pif();
-    result[i] = make_particle(config, pos, head);
+//  Calls `f(dst_array, src_array)` for each per-particle array.
+template <typename Dst, typename Src, typename F>
+void for_each_particle_array(Dst& dst, Src& src, F&& f) {
+  f(dst.position_x, src.position_x);
+  f(dst.position_y, src.position_y);
+  f(dst.heading_x, src.heading_x);
+  f(dst.heading_y, src.heading_y);
+  f(dst.left_sensor_x, src.left_sensor_x);
+  f(dst.left_sensor_y, src.left_sensor_y);
+  f(dst.right_sensor_x, src.right_sensor_x);
+  f(dst.right_sensor_y, src.right_sensor_y);
+  f(dst.sensor_step_size, src.sensor_step_size);
+  f(dst.sensor_size, src.sensor_size);
+  f(dst.speed, src.speed);
+  f(dst.deposit, src.deposit);
+  f(dst.channel_weights, src.channel_weights);
+  f(dst.sensor_speed_sensitivity, src.sensor_speed_sensitivity);
+  f(dst.sensor_speed_sensitivity_scale, src.sensor_speed_sensitivity_scale);
+  f(dst.turn_speed, src.turn_speed);
+  f(dst.right_only, src.right_only);
+  f(dst.turn_cos, src.turn_cos);
+  f(dst.turn_sin, src.turn_sin);
+}
+
+/*
+ * Reorders particles along a Z-order curve over a 2^k x 2^k grid of cells, so that particles near
+ * each other in the world are near each other in the arrays and the update and deposit passes walk
+ * the trail map coherently. The keys are sorted with an LSD radix sort, which is stable, so
+ * particles within a cell keep their relative order. Keys, digit counts and scatters run over
+ * chunks of particles on the pool. Nothing moves if the particles are still in order, and chunks
+ * whose particles all stay where they are are copied rather than gathered.
+ */
+void spatial_sort_particles(
+  SlimeParticles& parts, SlimeMoldSimulationWorkspace& ws, ThreadPool* pool) {
+  //
+  constexpr int cell_bits = 10;  //  per axis
+  constexpr int digit_bits = cell_bits;
+  constexpr int num_buckets = 1 << digit_bits;
+  constexpr float num_cells = float(1 << cell_bits);
+
+  const int n = parts.size();
+  const int num_chunks = pool && pool->num_threads() > 1 ? pool->num_threads() * 4 : 1;
+  const int chunk = std::max(1, (n + num_chunks - 1) / num_chunks);
+  auto for_each_chunk = [&](auto&& f) {
+    auto task = [&](int c) {
+      const int begin = std::min(n, c * chunk);
+      f(c, begin, std::min(n, begin + chunk));
+    };
+    if (num_chunks > 1) {
+      pool->parallel_for(num_chunks, task);
+    } else {
+      task(0);
+    }
+  };
+
+  ws.sort_keys.resize(n * 2);
+  ws.sort_order.resize(n * 2);
+  ws.sort_counts.resize(num_chunks * num_buckets);
+  ws.sort_chunk_moved.resize(num_chunks);
+  uint32_t* keys = ws.sort_keys.data();
+  uint32_t* keys_tmp = keys + n;
+  int* order = ws.sort_order.data();
+  int* order_tmp = order + n;
+  int* counts = ws.sort_counts.data();
+  uint8_t* moved = ws.sort_chunk_moved.data();
+
+  for_each_chunk([&](int c, int begin, int end) {
+    bool in_order = true;
+    for (int i = begin; i < end; i++) {
+      const auto cx = uint32_t(clamp(parts.position_x[i] * num_cells, 0.0f, num_cells - 1.0f));
+      const auto cy = uint32_t(clamp(parts.position_y[i] * num_cells, 0.0f, num_cells - 1.0f));
+      keys[i] = part1by1(cx) | (part1by1(cy) << 1);
+      order[i] = i;
+      in_order = in_order && (i == begin || keys[i - 1] <= keys[i]);
+    }
+    moved[c] = !in_order;
+  });
+  bool in_order = true;
+  for (int c = 0; c < num_chunks; c++) {
+    const int begin = std::min(n, c * chunk);
+    const bool after_prev = begin == 0 || begin == n || keys[begin - 1] <= keys[begin];
+    in_order = in_order && !moved[c] && after_prev;
   }
-  return result;
+  if (in_order) {
+    return;
+  }
+
+  for (int pass = 0; pass < (2 * cell_bits) / digit_bits; pass++) {
+    const int shift = pass * digit_bits;
+    auto digit = [&](int i) {
+      return (keys[i] >> shift) & (num_buckets - 1);
+    };
+    for_each_chunk([&](int c, int begin, int end) {
+      int* chunk_counts = counts + c * num_buckets;
+      std::fill(chunk_counts, chunk_counts + num_buckets, 0);
+      for (int i = begin; i < end; i++) {
+        chunk_counts[digit(i)]++;
+      }
+    });
+    int off{};
+    for (int b = 0; b < num_buckets; b++) {
+      for (int c = 0; c < num_chunks; c++) {
+        const int ct = counts[c * num_buckets + b];
+        counts[c * num_buckets + b] = off;
+        off += ct;
+      }
+    }
+    for_each_chunk([&](int c, int begin, int end) {
+      int* chunk_offsets = counts + c * num_buckets;
+      for (int i = begin; i < end; i++) {
+        const int dst = chunk_offsets[digit(i)]++;
+        keys_tmp[dst] = keys[i];
+        order_tmp[dst] = order[i];
+      }
+    });
+    std::swap(keys, keys_tmp);
+    std::swap(order, order_tmp);
+  }
+
+  for_each_chunk([&](int c, int begin, int end) {
+    bool same = true;
+    for (int i = begin; i < end && same; i++) {
+      same = order[i] == i;
+    }
+    moved[c] = !same;
+  });
+
+  //  Each array is gathered into its scratch array, which then takes its place.
+  if (ws.sort_scratch.size() < n) {
+    ws.sort_scratch = make_particles(n);
+  }
+  for_each_particle_array(ws.sort_scratch, parts, [&](auto& dst, auto& src) {
+    for_each_chunk([&](int c, int begin, int end) {
+      if (moved[c]) {
+        for (int i = begin; i < end; i++) {
+          dst[i] = src[order[i]];
+        }
+      } else {
+        std::copy(src.get() + begin, src.get() + end, dst.get() + begin);
+      }
+    });
+    std::swap(dst, src);
+  });
+  //  The arrays the particles gave up hold at least n.
+  ws.sort_scratch.num_particles = n;
 }
 
-UpdateSlimeMoldParticlesResult gen::update_slime_mold_particles(
-  SlimeParticle* particles, const SlimeMoldConfig& config, SlimeMoldSimulationContext* context) {
+//  Points `tiles` at `map`, starting over with every tile active if they described another map.
+void bind_active_tiles(
+  SlimeMoldActiveTiles& tiles, const void* map, IntegralType type, int width, int height) {
+  //
+  constexpr int tw = SlimeMoldActiveTiles::tile_width;
+  if (tiles.map == map && tiles.map_storage_type == type &&
+      tiles.width == width && tiles.height == height) {
+    return;
+  }
+  tiles.map = map;
+  tiles.map_storage_type = type;
+  tiles.width = width;
+  tiles.height = height;
+  tiles.tiles_x = (width + tw - 1) / tw;
+  tiles.rgbau8 = nullptr;
+  tiles.active.assign(size_t(height) * tiles.tiles_x, 1);
+  tiles.perturb.clear();
+  tiles.unpacked.clear();
+}
+
+template <typename T>
+void find_nonzero_tiles(MapView<const T> im, int tiles_x, std::vector<uint8_t>& bits) {
+  bits.assign(size_t(im.height) * tiles_x, 0);
+  for (int j = 0; j < im.height; j++) {
+    for (int i = 0; i < im.width; i++) {
+      const T* texel = im.texel(i, j);
+      for (int k = 0; k < im.color_channels; k++) {
+        if (to_float(texel[k]) > 0.0f) {
+          bits[j * tiles_x + i / SlimeMoldActiveTiles::tile_width] = 1;
+        }
+      }
+    }
+  }
+}
+
+template <typename T>
+UpdateSlimeMoldParticlesResult update_with_map_storage(
+  SlimeParticles& particles, const SlimeMoldConfig& config, SlimeMoldSimulationContext* context) {
   //
   UpdateSlimeMoldParticlesResult result{};
+  const int num_particles = particles.size();
 
   auto t0 = std::chrono::high_resolution_clock::now();
 
-  auto* data0 = context->texture_data0;
-  auto* data1 = context->texture_data1;
-  auto* tmp = context->texture_data2;
+  const int w = context->texture_width;
+  const int h = context->texture_height;
+  MapView<T> data0{static_cast<T*>(context->texture_data0), w, h};
+  MapView<T> perturb_data{static_cast<T*>(context->perturb_data), w, h};
+  MapView<T> signal_data{static_cast<T*>(context->signal_data), w, h};
+
+  auto* pool = context->thread_pool;
+  if (pool) {
+    pool->set_num_threads(config.num_threads);
+  }
+
+  if (particles.turn_rotation_dt != config.dt()) {
+    update_turn_rotation(particles, config.dt());
+  }
+
+  SlimeMoldSimulationWorkspace tmp_ws;
+  auto& ws = context->workspace ? *context->workspace : tmp_ws;
+  SlimeMoldActiveTiles* active{};
+  if (config.active_tile_tracking && context->workspace) {
+    active = &ws.active_tiles;
+    bind_active_tiles(*active, data0.data, context->map_storage_type, w, h);
+  } else {
+    //  nothing marks the map while tracking is off
+    ws.active_tiles.invalidate();
+  }
+  //  Names this step's random streams; wraps after 2^32 steps.
+  const auto step = uint32_t(context->tot_iter);
+
+  if (config.spatial_sort_interval > 0 &&
+      context->tot_iter % uint64_t(config.spatial_sort_interval) == 0) {
+    auto bt0 = std::chrono::high_resolution_clock::now();
+    spatial_sort_particles(particles, ws, pool);
+    result.sort_ms = float(std::chrono::duration<double>(
+      std::chrono::high_resolution_clock::now() - bt0).count() * 1e3);
+  }
 
   {
     auto bt0 = std::chrono::high_resolution_clock::now();
-    for (int i = 0; i < config.num_particles; i++) {
-      update_particle(config, particles[i], data0, *context->direction_influencing_image);
+    const auto& dir_im = *context->direction_influencing_image;
+
+    SummedAreaTable sat_storage;
+    const SummedAreaTable* sat{};
+    if (config.summed_area_sensing) {
+      sat_storage = build_summed_area_table(
+        MapView<const T>(data0), config.circular_world, pool, ws);
+      sat = &sat_storage;
     }
+
+    with_fixed_map_dims(MapView<const T>(data0), [&](auto im) {
+      if (pool && pool->num_threads() > 1) {
+        update_particles_parallel(*pool, config, particles, im, sat, dir_im, step);
+      } else {
+        update_particles(config, particles, 0, num_particles, im, sat, dir_im, step);
+      }
+    });
     result.update_ms = float(std::chrono::duration<double>(
       std::chrono::high_resolution_clock::now() - bt0).count() * 1e3);
   }
 
   {
     auto bt0 = std::chrono::high_resolution_clock::now();
-    for (int i = 0; i < config.num_particles; i++) {
-      deposit(particles[i], data0);
-    }
+    const TileMarks marks{active ? active->active.data() : nullptr, active ? active->tiles_x : 0};
+    with_fixed_map_dims(data0, [&](auto data) {
+      if (pool && pool->num_threads() > 1) {
+        deposit_particles_parallel(*pool, particles, data, ws, marks);
+      } else {
+        deposit_particles(particles, 0, num_particles, data, marks);
+      }
+    });
     result.deposit_ms = float(std::chrono::duration<double>(
       std::chrono::high_resolution_clock::now() - bt0).count() * 1e3);
   }
 
   {
     auto bt0 = std::chrono::high_resolution_clock::now();
-    if (config.diffuse_enabled) {
-      diffuse(data0, data1, tmp, config.decay, config.diffuse_speed, config.filter_size);
+    PostStepStageTimes stage_times{};
+    auto* times = config.post_step_stage_timing ? &stage_times : nullptr;
+    auto elapsed_ms = [](auto t0) {
+      return float(std::chrono::duration<double>(
+        std::chrono::high_resolution_clock::now() - t0).count() * 1e3);
+    };
+
+    PostStepPass<T> pass{};
+    pass.diffuse = config.diffuse_enabled && config.filter_size > 0;
+    pass.filter_size = config.filter_size;
+    pass.diffuse_speed = config.diffuse_speed;
+    pass.decay = config.decay;
+    pass.active = active;
+
+    //  Perturbation patterns are derived from the diffused map, so generating one splits the
+    //  post-step pass in two.
+    const uint64_t next_iter = context->tot_iter + 1;
+    const bool perturb_event =
+      config.allow_perturb_event && (next_iter % config.perturb_interval == 0);
+    if (!context->set_perturb_data || perturb_event) {
+      if (pass.diffuse) {
+        post_step(pass, data0, pool, ws, times);
+        pass.diffuse = false;
+      }
+      auto pt0 = std::chrono::high_resolution_clock::now();
+      if (!context->set_perturb_data) {
+        set_perturb_data(
+          config, MapView<const T>(data0), perturb_data, uint32_t(next_iter), pool);
+        context->set_perturb_data = true;
+      }
+      if (perturb_event) {
+        set_perturb_data(
+          config, MapView<const T>(data0), perturb_data, uint32_t(next_iter), pool);
+        context->perturb_state = 1;
+      }
+      if (active) {
+        find_nonzero_tiles(MapView<const T>(perturb_data), active->tiles_x, active->perturb);
+      }
+      stage_times.ms[PostStepPerturb] += elapsed_ms(pt0);
+    }
+    context->tot_iter = next_iter;
+
+    if (config.allow_signal_influence) {
+      const auto& params = *context->params;
+      if (!context->set_signal_data || !same_signal_params(params, context->signal_data_params)) {
+        auto st0 = std::chrono::high_resolution_clock::now();
+        set_signal_data(signal_data, params);
+        context->signal_data_params = params;
+        context->set_signal_data = true;
+        stage_times.ms[PostStepSignal] += elapsed_ms(st0);
+      }
+      pass.signal_data = signal_data;
+      pass.signal_rect = signal_bounds(params, data0.height, data0.width);
     }
-    result.diffuse_ms = float(std::chrono::duration<double>(
-      std::chrono::high_resolution_clock::now() - bt0).count() * 1e3);
-  }
-
-  if (!context->set_perturb_data) {
-    set_perturb_data(config, data0, context->perturb_data);
-    context->set_perturb_data = true;
-  }
-
-  context->tot_iter++;
-  if (config.allow_perturb_event && (context->tot_iter % config.perturb_interval == 0)) {
-    set_perturb_data(config, data0, context->perturb_data);
-    context->perturb_state = 1;
-  }
-
-  if (config.allow_signal_influence) {
-    set_signal_data(context->signal_data, *context->params);
-    apply_signal(context->signal_data, data0);
-  }
 
-  switch (context->perturb_state) {
-    case 1: {
-      apply_perturb(context->perturb_data, data0);
+    if (context->perturb_state == 1) {
+      pass.perturb_data = perturb_data;
       if (context->perturb_iters++ >= config.num_perturb_iters) {
         context->perturb_iters = 0;
         context->perturb_state = 0;
       }
-      break;
     }
+
+    pass.average = config.average_image;
+    if (!context->skip_rgbau8_pack) {
+      pass.rgbau8_data = context->rgbau8_texture_data0;
+      pass.rgbau8_rect = {0, 0, w - 1, h - 1};
+      pass.rgbau8_stride = w;
+      pass.rgbau8_dirty = context->rgbau8_dirty;
+    }
+    post_step(pass, data0, pool, ws, times);
+
+    result.post_step_ms = elapsed_ms(bt0);
+    result.diffuse_ms = stage_times.ms[PostStepDiffuse];
+    result.signal_ms = stage_times.ms[PostStepSignal];
+    result.perturb_ms = stage_times.ms[PostStepPerturb];
+    result.average_ms = stage_times.ms[PostStepAverage];
+    result.pack_ms = stage_times.ms[PostStepPack];
   }
 
   auto dt_ms = std::chrono::duration<double>(
     std::chrono::high_resolution_clock::now() - t0).count() * 1e3;
+  result.dt_ms = float(dt_ms);
+  return result;
+}
 
-  if (config.average_image) {
-    for (int i = 0; i < Config::texture_dim * Config::texture_dim; i++) {
-      float mu{};
-      for (int j = 0; j < 3; j++) {
-        mu += clamp(context->texture_data0[i * 3 + j], 0.0f, 1.0f);
-      }
-      mu /= 3.0f;
-      for (int j = 0; j < 3; j++) {
-        context->texture_data0[i * 3 + j] = mu;
+template <typename T>
+void resample_map(MapView<const T> src, MapView<T> dst) {
+  const float sx = float(src.width) / float(dst.width);
+  const float sy = float(src.height) / float(dst.height);
+  for (int j = 0; j < dst.height; j++) {
+    //  texel centers line up
+    const float y = std::clamp((float(j) + 0.5f) * sy - 0.5f, 0.0f, float(src.height - 1));
+    const int y0 = int(y);
+    const int y1 = std::min(y0 + 1, src.height - 1);
+    const float fy = y - float(y0);
+    for (int i = 0; i < dst.width; i++) {
+      const float x = std::clamp((float(i) + 0.5f) * sx - 0.5f, 0.0f, float(src.width - 1));
+      const int x0 = int(x);
+      const int x1 = std::min(x0 + 1, src.width - 1);
+      const float fx = x - float(x0);
+      for (int k = 0; k < MapView<T>::color_channels; k++) {
+        const float a = lerp(fx, to_float(src.texel(x0, y0)[k]), to_float(src.texel(x1, y0)[k]));
+        const float b = lerp(fx, to_float(src.texel(x0, y1)[k]), to_float(src.texel(x1, y1)[k]));
+        dst.texel(i, j)[k] = from_float<T>(lerp(fy, a, b));
       }
     }
   }
+}
 
-  for (int i = 0; i < Config::texture_dim * Config::texture_dim; i++) {
-    for (int j = 0; j < 3; j++) {
-      const int srci = i * 3 + j;
-      const int dsti = i * 4 + j;
-      context->rgbau8_texture_data0[dsti] = uint8_t(
-        clamp(context->texture_data0[srci], 0.0f, 1.0f) * 255.0f);
+} //  anon
+
+void gen::ImageDirtyRegion::add(const Rect& rect) {
+  if (rect.x1 <= rect.x0 || rect.y1 <= rect.y0) {
+    return;
+  }
+  auto bounds = [](const Rect& a, const Rect& b) -> Rect {
+    return {
+      std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1)};
+  };
+  for (auto& r : rects) {
+    //  Stacked with the same columns, or side by side over the same rows, or one inside the other.
+    const bool stacked = r.x0 == rect.x0 && r.x1 == rect.x1 && rect.y0 <= r.y1 && r.y0 <= rect.y1;
+    const bool beside = r.y0 == rect.y0 && r.y1 == rect.y1;
+    const bool inside = rect.x0 >= r.x0 && rect.x1 <= r.x1 && rect.y0 >= r.y0 && rect.y1 <= r.y1;
+    if (stacked || beside || inside) {
+      r = bounds(r, rect);
+      return;
     }
   }
+  if (int(rects.size()) < max_rects) {
+    rects.push_back(rect);
+    return;
+  }
+  Rect all = rect;
+  for (auto& r : rects) {
+    all = bounds(all, r);
+  }
+  rects.assign(1, all);
+}
 
-  result.dt_ms = float(dt_ms);
+std::unique_ptr<unsigned char[]> gen::make_slime_mold_map_data(
+  int width, int height, IntegralType type) {
+  //
+  return make_map_data(type, width, height);
+}
+
+std::unique_ptr<uint8_t[]> gen::make_rgbau8_slime_mold_texture_data(int width, int height) {
+  return std::make_unique<uint8_t[]>(size_t(width) * height * 4);
+}
+
+DefaultSlimeMoldSimulationTextureData gen::make_default_slime_mold_texture_data(
+  int width, int height, IntegralType map_storage_type) {
+  //
+  DefaultSlimeMoldSimulationTextureData result;
+  result.map_storage_type = map_storage_type;
+  result.width = width;
+  result.height = height;
+  result.texture_data0 = make_slime_mold_map_data(width, height, map_storage_type);
+  result.perturb_data = make_slime_mold_map_data(width, height, map_storage_type);
+  result.signal_data = make_slime_mold_map_data(width, height, map_storage_type);
+  result.rgbau8_texture_data = make_rgbau8_slime_mold_texture_data(width, height);
+  return result;
+}
+
+SlimeParticles gen::make_slime_mold_particles(const SlimeMoldConfig& config) {
+  auto result = make_particles(config.num_particles);
+  for (int i = 0; i < config.num_particles; i++) {
+    CounterRng rng(config.seed, ParticleInit, uint32_t(i));
+    auto pos = Vec2f{rng.urand_11f(), rng.urand_11f()} * Config::starting_offset_span + 0.5f;
+    auto head = rng.urandf() * 2.0f * pif();
+    write_particle(result, i, make_particle(config, rng, pos, head));
+  }
+  return result;
+}
+
+SlimeParticle gen::read_particle(const SlimeParticles& particles, int i) {
+  SlimeParticle result{};
+  result.position = Vec2f{particles.position_x[i], particles.position_y[i]};
+  result.heading = std::atan2(particles.heading_y[i], particles.heading_x[i]);
+  result.left_sensor = std::atan2(particles.left_sensor_y[i], particles.left_sensor_x[i]);
+  result.right_sensor = std::atan2(particles.right_sensor_y[i], particles.right_sensor_x[i]);
+  result.sensor_step_size = particles.sensor_step_size[i];
+  result.sensor_size = particles.sensor_size[i];
+  result.speed = particles.speed[i];
+  result.deposit = particles.deposit[i];
+  result.channel_weights = particles.channel_weights[i];
+  result.sensor_speed_sensitivity = particles.sensor_speed_sensitivity[i];
+  result.sensor_speed_sensitivity_scale = particles.sensor_speed_sensitivity_scale[i];
+  result.turn_speed = particles.turn_speed[i];
+  result.right_only = particles.right_only[i];
+  return result;
+}
+
+void gen::write_particle(SlimeParticles& particles, int i, const SlimeParticle& part) {
+  particles.position_x[i] = part.position.x;
+  particles.position_y[i] = part.position.y;
+  const auto head = to_vec(part.heading);
+  const auto left = to_vec(part.left_sensor);
+  const auto right = to_vec(part.right_sensor);
+  particles.heading_x[i] = head.x;
+  particles.heading_y[i] = head.y;
+  particles.left_sensor_x[i] = left.x;
+  particles.left_sensor_y[i] = left.y;
+  particles.right_sensor_x[i] = right.x;
+  particles.right_sensor_y[i] = right.y;
+  particles.sensor_step_size[i] = part.sensor_step_size;
+  particles.sensor_size[i] = part.sensor_size;
+  particles.speed[i] = part.speed;
+  particles.deposit[i] = part.deposit;
+  particles.channel_weights[i] = part.channel_weights;
+  particles.sensor_speed_sensitivity[i] = part.sensor_speed_sensitivity;
+  particles.sensor_speed_sensitivity_scale[i] = part.sensor_speed_sensitivity_scale;
+  particles.turn_speed[i] = part.turn_speed;
+  particles.right_only[i] = part.right_only;
+  particles.turn_rotation_dt = 0.0f;
+}
+
+void gen::copy_particle(
+  const SlimeParticles& src, int src_i, SlimeParticles& dst, int dst_i) {
+  //
+  for_each_particle_array(dst, src, [&](auto& d, const auto& s) {
+    d[dst_i] = s[src_i];
+  });
+}
+
+size_t gen::packed_particle_size() {
+  const SlimeParticles parts;
+  size_t size{};
+  for_each_particle_array(parts, parts, [&](const auto& a, const auto&) {
+    size += sizeof(a[0]);
+  });
+  return size;
+}
+
+void gen::pack_particle(const SlimeParticles& src, int i, unsigned char* dst) {
+  for_each_particle_array(src, src, [&](const auto& a, const auto&) {
+    std::memcpy(dst, &a[i], sizeof(a[i]));
+    dst += sizeof(a[i]);
+  });
+}
+
+void gen::unpack_particle(const unsigned char* src, SlimeParticles& dst, int i) {
+  for_each_particle_array(dst, dst, [&](auto& a, const auto&) {
+    std::memcpy(&a[i], src, sizeof(a[i]));
+    src += sizeof(a[i]);
+  });
+}
+
+void gen::reserve_particles(SlimeParticles& particles, int capacity) {
+  auto result = make_particles(capacity);
+  const int n = std::min(particles.size(), capacity);
+  for_each_particle_array(result, particles, [&](auto& d, const auto& s) {
+    std::copy(s.get(), s.get() + n, d.get());
+  });
+  result.num_particles = n;
+  result.turn_rotation_dt = particles.turn_rotation_dt;
+  particles = std::move(result);
+}
+
+void gen::set_particle_count(
+  SlimeParticles& particles, SlimeMoldConfig& config, int num_particles) {
+  //
+  const int prev = particles.size();
+  if (num_particles == prev) {
+    return;
+  }
+  reserve_particles(particles, num_particles);
+  particles.num_particles = num_particles;
+  for (int i = prev; i < num_particles; i++) {
+    CounterRng rng(config.seed, ParticleRespawn, uint32_t(i), uint32_t(prev));
+    const auto pos = prev > 0 ?
+      Vec2f{particles.position_x[i % prev], particles.position_y[i % prev]} :
+      Vec2f{rng.urand_11f(), rng.urand_11f()} * Config::starting_offset_span + 0.5f;
+    const auto head = rng.urandf() * 2.0f * pif();
+    write_particle(particles, i, make_particle(config, rng, pos, head));
+  }
+  if (num_particles > prev) {
+    //  the new particles' turns are not cached yet
+    particles.turn_rotation_dt = 0.0f;
+  }
+  config.num_particles = num_particles;
+}
+
+void gen::resample_slime_mold_map(
+  const void* src, int src_width, int src_height, void* dst, int dst_width, int dst_height,
+  IntegralType type) {
+  //
+  switch (type) {
+    case IntegralType::HalfFloat:
+      resample_map<Half>(
+        {static_cast<const Half*>(src), src_width, src_height},
+        {static_cast<Half*>(dst), dst_width, dst_height});
+      break;
+    case IntegralType::UnsignedShort:
+      resample_map<Unorm16>(
+        {static_cast<const Unorm16*>(src), src_width, src_height},
+        {static_cast<Unorm16*>(dst), dst_width, dst_height});
+      break;
+    default:
+      assert(type == IntegralType::Float);
+      resample_map<float>(
+        {static_cast<const float*>(src), src_width, src_height},
+        {static_cast<float*>(dst), dst_width, dst_height});
+  }
+}
+
+UpdateSlimeMoldParticlesResult gen::update_slime_mold_particles(
+  SlimeParticles& particles, const SlimeMoldConfig& config, SlimeMoldSimulationContext* context) {
+  //
+  switch (context->map_storage_type) {
+    case IntegralType::HalfFloat:
+      return update_with_map_storage<Half>(particles, config, context);
+    case IntegralType::UnsignedShort:
+      return update_with_map_storage<Unorm16>(particles, config, context);
+    default:
+      assert(context->map_storage_type == IntegralType::Float);
+      return update_with_map_storage<float>(particles, config, context);
+  }
+}
+
+UpdateSlimeMoldParticlesResult gen::update_slime_mold_substeps(
+  SlimeParticles& particles, const SlimeMoldConfig& config, SlimeMoldSimulationContext* context,
+  SlimeMoldSubstepper& substepper, float frame_s) {
+  //
+  auto step_config = config;
+  step_config.time_scale = std::min(config.time_scale, 1.0f);
+  const double step_s = step_config.dt();
+  substepper.owed_s += double(std::min(frame_s, substepper.max_frame_s) * config.time_scale);
+
+  //  Rounding the steps owed to the nearest whole keeps a frame rate that matches the step size
+  //  from alternating between zero and two steps a frame.
+  UpdateSlimeMoldParticlesResult result{};
+  const bool skip_pack = context->skip_rgbau8_pack;
+  const auto t0 = std::chrono::high_resolution_clock::now();
+  int n{};
+  bool last{};
+  while (!last && step_s > 0.0 && substepper.owed_s >= 0.5 * step_s) {
+    const float elapsed_ms = float(std::chrono::duration<double>(
+      std::chrono::high_resolution_clock::now() - t0).count() * 1e3);
+    last = n + 1 >= substepper.max_substeps ||
+      substepper.owed_s - step_s < 0.5 * step_s ||
+      elapsed_ms + 2.0f * substepper.substep_ms > substepper.budget_ms;
+
+    context->skip_rgbau8_pack = skip_pack || !last;
+    const auto res = update_slime_mold_particles(particles, step_config, context);
+    substepper.owed_s -= step_s;
+    n++;
+
+    result.dt_ms += res.dt_ms;
+    result.sort_ms += res.sort_ms;
+    result.update_ms += res.update_ms;
+    result.deposit_ms += res.deposit_ms;
+    result.post_step_ms += res.post_step_ms;
+    result.diffuse_ms += res.diffuse_ms;
+    result.signal_ms += res.signal_ms;
+    result.perturb_ms += res.perturb_ms;
+    result.average_ms += res.average_ms;
+    result.pack_ms += res.pack_ms;
+    substepper.substep_ms = res.dt_ms;
+  }
+  context->skip_rgbau8_pack = skip_pack;
+  if (substepper.owed_s >= 0.5 * step_s) {
+    //  stopped short; drop the rest
+    substepper.owed_s = 0.0;
+  }
+  substepper.last_num_substeps = n;
   return result;
 }
 
 void gen::set_particle_turn_speed_power(
-  SlimeParticle* particles, SlimeMoldConfig& config, int new_power) {
+  SlimeParticles& particles, SlimeMoldConfig& config, int new_power) {
   //
   float scale = power_to_scale(config.turn_speed_power, new_power);
   if (scale != 1.0f) {
-    scale_turn_speed(particles, config.num_particles, scale);
+    scale_turn_speed(particles, scale);
     config.turn_speed_power = new_power;
   }
 }
 
 void gen::set_particle_speed_power(
-  SlimeParticle* particles, SlimeMoldConfig& config, int new_power) {
+  SlimeParticles& particles, SlimeMoldConfig& config, int new_power) {
   //
   float scale = power_to_scale(config.scale_speed_power, new_power);
   if (scale != 1.0f) {
-    scale_speed(particles, config.num_particles, scale);
+    scale_speed(particles, scale);
     config.scale_speed_power = new_power;
   }
 }
 
-void gen::set_particle_right_only(SlimeParticle* particles, SlimeMoldConfig& config, bool value) {
-  set_right_only(particles, config.num_particles, value);
-}
\ No newline at end of file
+void gen::set_particle_right_only(SlimeParticles& particles, SlimeMoldConfig&, bool value) {
+  set_right_only(particles, value);
+}
+
+void gen::kernels::update_particles(
+  const SlimeMoldConfig& config, SlimeParticles& parts, MapView<const float> map,
+  ThreadPool* pool) {
+  //
+  if (parts.turn_rotation_dt != config.dt()) {
+    update_turn_rotation(parts, config.dt());
+  }
+  const DirectionInfluencingImage dir_im{};
+  with_fixed_map_dims(map, [&](auto im) {
+    if (pool && pool->num_threads() > 1) {
+      update_particles_parallel(*pool, config, parts, im, nullptr, dir_im, 0);
+    } else {
+      ::update_particles(config, parts, 0, parts.size(), im, nullptr, dir_im, 0);
+    }
+  });
+}
+
+Vec3f gen::kernels::sense(MapView<const float> map, const Vec2f& p, float win_size) {
+  return with_fixed_map_dims(map, [&](auto im) {
+    return ::sense(im, p, win_size);
+  });
+}
+
+Vec3f gen::kernels::sense_circular(MapView<const float> map, const Vec2f& p, float win_size) {
+  return with_fixed_map_dims(map, [&](auto im) {
+    return ::sense_circular(im, p, win_size, false);
+  });
+}
+
+void gen::kernels::deposit_particles(
+  const SlimeParticles& parts, MapView<float> map, ThreadPool* pool,
+  SlimeMoldSimulationWorkspace& ws) {
+  //
+  with_fixed_map_dims(map, [&](auto data) {
+    if (pool && pool->num_threads() > 1) {
+      deposit_particles_parallel(*pool, parts, data, ws);
+    } else {
+      ::deposit_particles(parts, 0, parts.size(), data);
+    }
+  });
+}
+
+void gen::kernels::box_filter(
+  MapView<const float> map, MapView<float> out, MapView<float> tmp, int filter_size) {
+  //
+  ::box_filter(map, out, tmp, filter_size);
+}
+
+void gen::kernels::post_step(
+  const PostStepStages& stages, MapView<float> data, ThreadPool* pool,
+  SlimeMoldSimulationWorkspace& ws) {
+  //
+  PostStepPass<float> pass{};
+  pass.diffuse = stages.diffuse && stages.filter_size > 0;
+  pass.filter_size = stages.filter_size;
+  pass.diffuse_speed = stages.diffuse_speed;
+  pass.decay = stages.decay;
+  if (stages.signal) {
+    pass.signal_data = {stages.signal, data.width, data.height};
+    pass.signal_rect = {0, 0, data.width - 1, data.height - 1};
+  }
+  if (stages.perturb) {
+    pass.perturb_data = {stages.perturb, data.width, data.height};
+  }
+  pass.average = stages.average;
+  pass.rgbau8_data = stages.rgbau8;
+  pass.rgbau8_rect = {0, 0, data.width - 1, data.height - 1};
+  pass.rgbau8_stride = data.width;
+  ::post_step(pass, data, pool, ws);
+}
+
+template <typename T>
+void gen::kernels::update_particles(
+  const SlimeMoldConfig& config, SlimeParticles& parts, MapWindowView<const T> map,
+  const DirectionInfluencingImage& dir_im, uint32_t step, uint32_t first_index,
+  uint32_t index_stride) {
+  //
+  if (parts.turn_rotation_dt != config.dt()) {
+    update_turn_rotation(parts, config.dt());
+  }
+  ::update_particles(
+    config, parts, 0, parts.size(), map, nullptr, dir_im, step, {first_index, index_stride});
+}
+
+template <typename T>
+void gen::kernels::deposit_particles(const SlimeParticles& parts, MapWindowView<T> map) {
+  ::deposit_particles(parts, 0, parts.size(), map);
+}
+
+template <typename T>
+void gen::kernels::post_step(
+  const PostStepStages& stages, MapView<T> data, SlimeMoldSimulationWorkspace& ws,
+  float* pack_ms) {
+  //
+  PostStepPass<T> pass{};
+  pass.diffuse = stages.diffuse && stages.filter_size > 0;
+  pass.filter_size = stages.filter_size;
+  pass.diffuse_speed = stages.diffuse_speed;
+  pass.decay = stages.decay;
+  pass.average = stages.average;
+  pass.rgbau8_data = stages.rgbau8;
+  pass.rgbau8_rect = {stages.pack_x0, stages.pack_y0, stages.pack_x1 - 1, stages.pack_y1 - 1};
+  pass.rgbau8_stride = stages.rgbau8_stride;
+  PostStepStageTimes times{};
+  if (stages.diffuse_first && pass.diffuse) {
+    PostStepPass<T> diffuse_pass{};
+    diffuse_pass.diffuse = true;
+    diffuse_pass.filter_size = pass.filter_size;
+    diffuse_pass.diffuse_speed = pass.diffuse_speed;
+    diffuse_pass.decay = pass.decay;
+    ::post_step(diffuse_pass, data, nullptr, ws, pack_ms ? &times : nullptr);
+    pass.diffuse = false;
+  }
+  ::post_step(pass, data, nullptr, ws, pack_ms ? &times : nullptr);
+  if (pack_ms) {
+    *pack_ms = times.ms[PostStepPack];
+  }
+}
+
+template void gen::kernels::update_particles<float>(
+  const SlimeMoldConfig&, SlimeParticles&, MapWindowView<const float>,
+  const DirectionInfluencingImage&, uint32_t, uint32_t, uint32_t);
+template void gen::kernels::update_particles<Half>(
+  const SlimeMoldConfig&, SlimeParticles&, MapWindowView<const Half>,
+  const DirectionInfluencingImage&, uint32_t, uint32_t, uint32_t);
+template void gen::kernels::update_particles<Unorm16>(
+  const SlimeMoldConfig&, SlimeParticles&, MapWindowView<const Unorm16>,
+  const DirectionInfluencingImage&, uint32_t, uint32_t, uint32_t);
+template void gen::kernels::deposit_particles<float>(const SlimeParticles&, MapWindowView<float>);
+template void gen::kernels::deposit_particles<Half>(const SlimeParticles&, MapWindowView<Half>);
+template void gen::kernels::deposit_particles<Unorm16>(
+  const SlimeParticles&, MapWindowView<Unorm16>);
+template void gen::kernels::post_step<float>(
+  const PostStepStages&, MapView<float>, SlimeMoldSimulationWorkspace&, float*);
+template void gen::kernels::post_step<Half>(
+  const PostStepStages&, MapView<Half>, SlimeMoldSimulationWorkspace&, float*);
+template void gen::kernels::post_step<Unorm16>(
+  const PostStepStages&, MapView<Unorm16>, SlimeMoldSimulationWorkspace&, float*);
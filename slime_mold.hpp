@@ -1,13 +1,16 @@
 #pragma once
 
 #include "base_math.hpp"
+#include "util.hpp"
 #include <memory>
+#include <vector>
 
-#define DYNAMIC_TEXTURE_SIZE (1)
 #define DEFAULT_TEXTURE_SIZE (256)
 
 namespace gen {
 
+class ThreadPool;
+
 /*
  * Slime mold sim. References:
  *  1. https://sagejenson.com/physarum
@@ -29,11 +32,6 @@ struct SlimeMoldConfig {
     diffuse_enabled = true;
   }
 
-#if DYNAMIC_TEXTURE_SIZE
-  static int texture_dim;
-#else
-  static constexpr int texture_dim = DEFAULT_TEXTURE_SIZE;
-#endif
   static constexpr int num_texture_channels = 3;
   int num_particles{1000};
 
@@ -43,6 +41,25 @@ struct SlimeMoldConfig {
   float diffuse_speed{default_diffuse_speed};
   bool diffuse_enabled{true};
   float time_scale{1.0f};
+  bool simd_update_enabled{true};
+  int num_threads{0}; //  <= 0: one per hardware thread
+  //  Sense through a summed-area table of the trail map, built once per step, so the cost of a
+  //  sensor does not depend on its size. Windows wrap around the edges when circular_world is set.
+  bool summed_area_sensing{false};
+  //  Reorder particles along a Z-order curve every this many steps; <= 0: never.
+  int spatial_sort_interval{0};
+  //  Element type of the trail, perturb and signal maps: Float, HalfFloat or UnsignedShort
+  //  (16-bit unorm). Takes effect when the texture data is (re)made.
+  IntegralType map_storage_type{IntegralType::Float};
+  //  Key for every random draw the simulation makes (initial particles, bounces, perturbation
+  //  noise), so a seed and a config reproduce a run exactly, on any number of threads.
+  uint64_t seed{};
+  //  Split the time of the fused post-deposit pass by stage, at the cost of a few clock reads
+  //  per map row.
+  bool post_step_stage_timing{true};
+  //  Skip post-deposit work over parts of the trail map that are zero and stay zero; see
+  //  SlimeMoldActiveTiles. Needs a workspace in the context.
+  bool active_tile_tracking{true};
 
   int num_perturb_iters{1000};
   int perturb_interval{3000};
@@ -82,53 +99,238 @@ struct SlimeParticle {
   bool right_only;
 };
 
+/*
+ * Structure-of-arrays particle store. The per-step state (position and heading) lives in its own
+ * arrays, apart from the per-particle constants, so the update and deposit passes only stream the
+ * fields they actually touch. The arrays hold at least `num_particles` elements; see
+ * `reserve_particles`.
+ */
+struct SlimeParticles {
+  int size() const {
+    return num_particles;
+  }
+
+  int num_particles{};
+
+  //  state; rewritten every step. The heading is a unit vector.
+  std::unique_ptr<float[]> position_x;
+  std::unique_ptr<float[]> position_y;
+  std::unique_ptr<float[]> heading_x;
+  std::unique_ptr<float[]> heading_y;
+
+  //  constants; only modified by the set_particle_* helpers. Sensor directions are unit vectors
+  //  fixed in world space, not relative to the heading.
+  std::unique_ptr<float[]> left_sensor_x;
+  std::unique_ptr<float[]> left_sensor_y;
+  std::unique_ptr<float[]> right_sensor_x;
+  std::unique_ptr<float[]> right_sensor_y;
+  std::unique_ptr<float[]> sensor_step_size;
+  std::unique_ptr<float[]> sensor_size;
+  std::unique_ptr<float[]> speed;
+  std::unique_ptr<float[]> deposit;
+  std::unique_ptr<Vec3f[]> channel_weights;
+  std::unique_ptr<float[]> sensor_speed_sensitivity;
+  std::unique_ptr<float[]> sensor_speed_sensitivity_scale;
+  std::unique_ptr<float[]> turn_speed;  //  radians per second
+  std::unique_ptr<bool[]> right_only;
+
+  //  A turn is a rotation by turn_speed * turn_rotation_dt, kept as its cosine and sine. Rebuilt
+  //  at the start of a step whenever the step size differs; 0 marks it stale.
+  float turn_rotation_dt{};
+  std::unique_ptr<float[]> turn_cos;
+  std::unique_ptr<float[]> turn_sin;
+};
+
 struct DirectionInfluencingImage {
-  std::unique_ptr<float[]> theta;
+  std::unique_ptr<Vec2f[]> direction;  //  unit vectors
   int w;
   int h;
 };
 
+/*
+ * Which parts of the trail map may hold nonzero texels. A zero texel with only zero texels within
+ * the filter radius stays zero through diffuse and decay and packs to zero, so the post-deposit
+ * pass only visits the columns near active tiles, and skips bands of rows without any. Deposit,
+ * signal and perturb mark what they write; the pass clears the tiles it leaves zero.
+ *
+ * Tiles are `tile_width` texels wide and one row tall, so each is only ever written by the band
+ * or thread that owns its row. The bits describe one map and the RGBA8 image last packed from it;
+ * any other map starts over with every tile active, and so must `invalidate` after writing the
+ * map outside of `update_slime_mold_particles`. Passes that do not pack note the tiles they
+ * visited in `unpacked`, for the next pass that does.
+ */
+struct SlimeMoldActiveTiles {
+  static constexpr int tile_width = 32;
+
+  void invalidate() {
+    map = nullptr;
+  }
+
+  const void* map{};
+  IntegralType map_storage_type{};
+  int width{};
+  int height{};
+  int tiles_x{};
+  const uint8_t* rgbau8{};
+  std::vector<uint8_t> active;  //  height x tiles_x
+  std::vector<uint8_t> perturb;  //  tiles the perturb map is nonzero in; empty if not known
+  std::vector<uint8_t> unpacked;  //  tiles changed since the last pack; empty if none
+};
+
+//  Scratch storage reused across steps.
+struct SlimeMoldSimulationWorkspace {
+  std::vector<int> particle_order;
+  std::vector<int> band_counts;
+  std::vector<int> band_offsets;
+  std::vector<float> post_step_scratch;
+  std::vector<double> post_step_col_sums;
+  std::vector<double> post_step_stage_s;
+  std::vector<double> summed_area_table;
+  std::vector<uint32_t> sort_keys;
+  std::vector<int> sort_order;
+  std::vector<int> sort_counts;
+  std::vector<uint8_t> sort_chunk_moved;
+  SlimeParticles sort_scratch;  //  gathered into by the spatial sort, then swapped in
+  std::vector<int> post_step_spans;
+  SlimeMoldActiveTiles active_tiles;
+};
+
+/*
+ * Parts of an RGBA8 image written since its consumer, e.g. a texture upload, last cleared it: a
+ * short list of rectangles covering every changed pixel, merged as they are added. Past
+ * `max_rects` they collapse into their bounding box.
+ */
+struct ImageDirtyRegion {
+  static constexpr int max_rects = 64;
+
+  //  Pixels [x0, x1) x [y0, y1).
+  struct Rect {
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+  };
+
+  bool empty() const {
+    return rects.empty();
+  }
+  void clear() {
+    rects.clear();
+  }
+  void add(const Rect& rect);
+
+  std::vector<Rect> rects;
+};
+
 struct SlimeMoldSimulationContext {
-  float* texture_data0;
+  //  trail, perturb and signal maps, each `texture_width` x `texture_height` texels (see
+  //  MapView); elements are of `map_storage_type`. Particles live in the unit square, which is
+  //  stretched over the map.
+  IntegralType map_storage_type;
+  int texture_width;
+  int texture_height;
+  void* texture_data0;
   uint8_t* rgbau8_texture_data0;
-  float* texture_data1;
-  float* texture_data2;
-  float* perturb_data;
-  float* signal_data;
+  void* perturb_data;
+  void* signal_data;
   bool set_perturb_data;
+  bool set_signal_data;
+  SlimeMoldParams signal_data_params;
   int perturb_state;
   int perturb_iters;
   uint64_t tot_iter;
   const SlimeMoldParams* params;
   const DirectionInfluencingImage* direction_influencing_image;
+  ThreadPool* thread_pool;  //  optional; null runs every phase on the calling thread
+  SlimeMoldSimulationWorkspace* workspace;
+  ImageDirtyRegion* rgbau8_dirty;  //  optional; gets the parts of the RGBA8 image a step packs
+  //  Leave the RGBA8 image as it is this step, e.g. for all but the last of several steps taken
+  //  per rendered frame; the next step that packs brings it up to date.
+  bool skip_rgbau8_pack;
 };
 
 struct DefaultSlimeMoldSimulationTextureData {
-  std::unique_ptr<float[]> texture_data0;
-  std::unique_ptr<float[]> texture_data1;
-  std::unique_ptr<float[]> texture_data2;
-  std::unique_ptr<float[]> perturb_data;
-  std::unique_ptr<float[]> signal_data;
+  IntegralType map_storage_type;
+  int width;
+  int height;
+  std::unique_ptr<unsigned char[]> texture_data0;
+  std::unique_ptr<unsigned char[]> perturb_data;
+  std::unique_ptr<unsigned char[]> signal_data;
   std::unique_ptr<uint8_t[]> rgbau8_texture_data;
 };
 
 struct UpdateSlimeMoldParticlesResult {
   float dt_ms;
+  float sort_ms;
   float update_ms;
   float deposit_ms;
+  float post_step_ms;  //  whole post-deposit pass: diffuse, signal, perturb, average and pack
+  //  Shares of post_step_ms by stage (see SlimeMoldConfig::post_step_stage_timing). Signal and
+  //  perturb include (re)making their maps.
   float diffuse_ms;
+  float signal_ms;
+  float perturb_ms;
+  float average_ms;
+  float pack_ms;
 };
 
-std::unique_ptr<float[]> make_slime_mold_texture_data();
-std::unique_ptr<uint8_t[]> make_rgbau8_slime_mold_texture_data();
-DefaultSlimeMoldSimulationTextureData make_default_slime_mold_texture_data();
-std::unique_ptr<SlimeParticle[]> make_slime_mold_particles(const SlimeMoldConfig& config);
+std::unique_ptr<unsigned char[]> make_slime_mold_map_data(
+  int width, int height, IntegralType type);
+std::unique_ptr<uint8_t[]> make_rgbau8_slime_mold_texture_data(int width, int height);
+DefaultSlimeMoldSimulationTextureData make_default_slime_mold_texture_data(
+  int width, int height, IntegralType map_storage_type = IntegralType::Float);
+SlimeParticles make_slime_mold_particles(const SlimeMoldConfig& config);
+SlimeParticle read_particle(const SlimeParticles& particles, int i);
+void write_particle(SlimeParticles& particles, int i, const SlimeParticle& part);
+//  Copies every array, including the cached turn rotation, so `src` and `dst` should step with
+//  the same dt.
+void copy_particle(const SlimeParticles& src, int src_i, SlimeParticles& dst, int dst_i);
+//  Reallocates the arrays to hold `capacity` particles, keeping the first min(size(), capacity).
+void reserve_particles(SlimeParticles& particles, int capacity);
+//  Particle `i` as a flat record of `packed_particle_size()` bytes, e.g. to hand to another
+//  process; unpacking restores exactly what `copy_particle` would copy.
+size_t packed_particle_size();
+void pack_particle(const SlimeParticles& src, int i, unsigned char* dst);
+void unpack_particle(const unsigned char* src, SlimeParticles& dst, int i);
 void set_particle_turn_speed_power(
-  SlimeParticle* particles, SlimeMoldConfig& config, int new_power);
+  SlimeParticles& particles, SlimeMoldConfig& config, int new_power);
 void set_particle_speed_power(
-  SlimeParticle* particles, SlimeMoldConfig& config, int new_power);
-void set_particle_right_only(SlimeParticle* particles, SlimeMoldConfig& config, bool value);
+  SlimeParticles& particles, SlimeMoldConfig& config, int new_power);
+void set_particle_right_only(SlimeParticles& particles, SlimeMoldConfig& config, bool value);
+/*
+ * Keeps the first `num_particles` particles, or adds particles up to it. New particles start on
+ * top of existing ones, taken in turn, with fresh headings and constants, so they join the
+ * pattern already laid down instead of starting over from the middle of the map.
+ */
+void set_particle_count(SlimeParticles& particles, SlimeMoldConfig& config, int num_particles);
+//  Bilinearly resamples map `src` into `dst`, of other dimensions; both hold `type` elements.
+void resample_slime_mold_map(
+  const void* src, int src_width, int src_height, void* dst, int dst_width, int dst_height,
+  IntegralType type);
 UpdateSlimeMoldParticlesResult update_slime_mold_particles(
-  SlimeParticle* particles, const SlimeMoldConfig& config, SlimeMoldSimulationContext* context);
+  SlimeParticles& particles, const SlimeMoldConfig& config, SlimeMoldSimulationContext* context);
+
+/*
+ * Fixed-timestep stepping against real time. A frame owes its length times `time_scale` in
+ * simulated time, paid off in steps of at most 1/60 s (shorter only when `time_scale` < 1), so a
+ * high time scale takes more steps rather than larger ones. A frame stops short at
+ * `max_substeps`, or when another step would overrun `budget_ms`, and drops what it still owes:
+ * a simulation that cannot keep up runs slower than real time instead of slowing the frame rate.
+ * Only the last step of a frame packs the RGBA8 image, so the budget can be overrun by at most
+ * one step.
+ */
+struct SlimeMoldSubstepper {
+  int max_substeps{8};
+  float budget_ms{12.0f};
+  float max_frame_s{0.1f};  //  longer frames, e.g. after a stall, count as this long
+  double owed_s{};  //  simulated time not yet stepped; within half a step of zero between frames
+  float substep_ms{};  //  estimated cost of a step; 0 if not known
+  int last_num_substeps{};
+};
+
+//  Steps for a frame `frame_s` seconds long; the result sums the timings of the steps taken.
+UpdateSlimeMoldParticlesResult update_slime_mold_substeps(
+  SlimeParticles& particles, const SlimeMoldConfig& config, SlimeMoldSimulationContext* context,
+  SlimeMoldSubstepper& substepper, float frame_s);
 
 }
\ No newline at end of file
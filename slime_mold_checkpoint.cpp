@@ -0,0 +1,559 @@
+#include "slime_mold_checkpoint.hpp"
+#include "map_storage.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <type_traits>
+
+namespace {
+
+using namespace gen;
+
+constexpr char checkpoint_magic[8]{'S', 'M', 'C', 'K', 'P', 'T', '\0', '\0'};
+constexpr uint32_t checkpoint_version = 1;
+constexpr uint32_t byte_order_mark = 0x01020304u;
+constexpr size_t section_alignment = 64;
+
+enum class SectionId : uint32_t {
+  Config = 1,
+  State,
+  Particles,
+  TrailMap,
+  PerturbMap,
+  SignalMap,
+  Image,
+};
+
+enum class SectionEncoding : uint32_t {
+  Raw = 0,
+  RunLength,
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t num_sections;
+  uint32_t reserved0;
+  uint64_t file_size;
+  unsigned char reserved[32];
+};
+static_assert(sizeof(Header) == section_alignment);
+
+//  The section table follows the header.
+struct SectionEntry {
+  uint32_t id;
+  uint32_t encoding;
+  uint64_t offset;
+  uint64_t stored_size;
+  uint64_t size;
+};
+static_assert(sizeof(SectionEntry) == 32);
+
+//  The context and particle state besides the particles and maps themselves.
+struct State {
+  int32_t width;
+  int32_t height;
+  IntegralType map_storage_type;
+  int32_t num_particles;
+  uint64_t particle_record_size;
+  float turn_rotation_dt;
+  uint64_t tot_iter;
+  int32_t perturb_state;
+  int32_t perturb_iters;
+  bool set_perturb_data;
+  bool set_signal_data;
+  SlimeMoldParams signal_data_params;
+  SlimeMoldParams params;
+};
+
+//  Fields go out one by one at fixed widths, so the format does not depend on struct layout.
+struct FieldWriter {
+  template <typename T>
+  void operator()(const T& v) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto* p = reinterpret_cast<const unsigned char*>(&v);
+    bytes.insert(bytes.end(), p, p + sizeof(T));
+  }
+  void operator()(const bool& v) {
+    bytes.push_back(uint8_t(v));
+  }
+  void operator()(const IntegralType& v) {
+    (*this)(int32_t(v));
+  }
+
+  std::vector<unsigned char> bytes;
+};
+
+struct FieldReader {
+  template <typename T>
+  void operator()(T& v) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    if (take(sizeof(T))) {
+      std::memcpy(&v, data + at - sizeof(T), sizeof(T));
+    }
+  }
+  void operator()(bool& v) {
+    if (take(1)) {
+      v = data[at - 1] != 0;
+    }
+  }
+  void operator()(IntegralType& v) {
+    int32_t i{};
+    (*this)(i);
+    v = IntegralType(i);
+  }
+  bool take(size_t n) {
+    ok = ok && at + n <= size;
+    at += ok ? n : 0;
+    return ok;
+  }
+
+  const unsigned char* data;
+  size_t size;
+  size_t at{};
+  bool ok{true};
+};
+
+template <typename IO, typename Params>
+void params_fields(IO& io, Params& p) {
+  io(p.signal_value);
+  io(p.signal_position);
+  io(p.signal_radius);
+  io(p.channel_mask);
+}
+
+//  In declaration order; appending fields is fine, anything else needs a new version.
+template <typename IO, typename Config>
+void config_fields(IO& io, Config& c) {
+  io(c.num_particles);
+  io(c.filter_size);
+  io(c.decay);
+  io(c.diffuse_speed);
+  io(c.diffuse_enabled);
+  io(c.time_scale);
+  io(c.simd_update_enabled);
+  io(c.num_threads);
+  io(c.summed_area_sensing);
+  io(c.spatial_sort_interval);
+  io(c.map_storage_type);
+  io(c.seed);
+  io(c.post_step_stage_timing);
+  io(c.active_tile_tracking);
+  io(c.num_perturb_iters);
+  io(c.perturb_interval);
+  io(c.perturb_event_type);
+  io(c.num_perturb_circles);
+  io(c.circular_world);
+  io(c.allow_perturb_event);
+  io(c.allow_signal_influence);
+  io(c.average_image);
+  io(c.scale_speed_power);
+  io(c.turn_speed_power);
+  io(c.only_right_turns);
+  io(c.direction_influencing_image_scale);
+}
+
+template <typename IO, typename S>
+void state_fields(IO& io, S& s) {
+  io(s.width);
+  io(s.height);
+  io(s.map_storage_type);
+  io(s.num_particles);
+  io(s.particle_record_size);
+  io(s.turn_rotation_dt);
+  io(s.tot_iter);
+  io(s.perturb_state);
+  io(s.perturb_iters);
+  io(s.set_perturb_data);
+  io(s.set_signal_data);
+  params_fields(io, s.signal_data_params);
+  params_fields(io, s.params);
+}
+
+/*
+ * Byte-wise run-length encoding: a control byte c < 128 is followed by c + 1 literal bytes; a
+ * control byte c >= 128 by one byte repeated c - 125 times (3 to 130).
+ */
+void run_length_encode(const unsigned char* src, size_t size, std::vector<unsigned char>& out) {
+  constexpr size_t max_literals = 128;
+  constexpr size_t min_run = 3;
+  constexpr size_t max_run = 130;
+  size_t lit_begin{};
+  auto flush_literals = [&](size_t end) {
+    while (lit_begin < end) {
+      const size_t n = std::min(max_literals, end - lit_begin);
+      out.push_back(uint8_t(n - 1));
+      out.insert(out.end(), src + lit_begin, src + lit_begin + n);
+      lit_begin += n;
+    }
+  };
+  size_t i{};
+  while (i < size) {
+    size_t run = 1;
+    while (i + run < size && run < max_run && src[i + run] == src[i]) {
+      run++;
+    }
+    if (run >= min_run) {
+      flush_literals(i);
+      out.push_back(uint8_t(128 + run - min_run));
+      out.push_back(src[i]);
+      i += run;
+      lit_begin = i;
+    } else {
+      i += run;
+    }
+  }
+  flush_literals(size);
+}
+
+bool run_length_decode(
+  const unsigned char* src, size_t size, unsigned char* dst, size_t dst_size) {
+  //
+  size_t at{};
+  size_t out{};
+  while (at < size) {
+    const unsigned char c = src[at++];
+    if (c < 128) {
+      const size_t n = size_t(c) + 1;
+      if (at + n > size || out + n > dst_size) {
+        return false;
+      }
+      std::memcpy(dst + out, src + at, n);
+      at += n;
+      out += n;
+    } else {
+      const size_t n = size_t(c) - 125;
+      if (at >= size || out + n > dst_size) {
+        return false;
+      }
+      std::memset(dst + out, src[at++], n);
+      out += n;
+    }
+  }
+  return out == dst_size;
+}
+
+size_t map_bytes(int width, int height, IntegralType type) {
+  return size_t(width) * height * MapView<float>::channels * size_of_integral_type(type);
+}
+
+size_t align_up(size_t n) {
+  return (n + section_alignment - 1) / section_alignment * section_alignment;
+}
+
+struct PendingSection {
+  SectionId id;
+  const unsigned char* data;
+  size_t size;
+  std::vector<unsigned char> encoded;  //  empty: stored as it is
+};
+
+const SectionEntry* find_section(const SectionEntry* table, uint32_t count, SectionId id) {
+  for (uint32_t i = 0; i < count; i++) {
+    if (table[i].id == uint32_t(id)) {
+      return &table[i];
+    }
+  }
+  return nullptr;
+}
+
+/*
+ * Whether `entry` can decode to `size` bytes, checked before allocating for them. A run expands
+ * two bytes to at most 130, so a section the file's stored sizes allow is at most 65 times the
+ * file's size and forged sizes cannot ask for more.
+ */
+bool section_fits(const SectionEntry* entry, size_t size) {
+  constexpr uint64_t max_run_expansion = 65;
+  if (!entry || entry->size != size) {
+    return false;
+  }
+  if (entry->encoding == uint32_t(SectionEncoding::Raw)) {
+    return entry->stored_size == size;
+  }
+  if (entry->encoding == uint32_t(SectionEncoding::RunLength)) {
+    return entry->stored_size >= size / max_run_expansion;
+  }
+  return false;
+}
+
+//  Decodes section `entry` of `data` into `size` bytes at `dst`.
+bool read_section(
+  const unsigned char* data, const SectionEntry& entry, unsigned char* dst, size_t size) {
+  //
+  if (!section_fits(&entry, size)) {
+    return false;
+  }
+  const unsigned char* src = data + entry.offset;
+  if (entry.encoding == uint32_t(SectionEncoding::Raw)) {
+    std::memcpy(dst, src, size);
+    return true;
+  }
+  return run_length_decode(src, size_t(entry.stored_size), dst, size);
+}
+
+} //  anon
+
+std::vector<unsigned char> gen::encode_slime_mold_checkpoint(
+  const SlimeParticles& particles, const SlimeMoldConfig& config,
+  const SlimeMoldSimulationContext& context, bool compress) {
+  //
+  const int w = context.texture_width;
+  const int h = context.texture_height;
+  const size_t record_size = packed_particle_size();
+
+  State state{};
+  state.width = w;
+  state.height = h;
+  state.map_storage_type = context.map_storage_type;
+  state.num_particles = particles.size();
+  state.particle_record_size = record_size;
+  state.turn_rotation_dt = particles.turn_rotation_dt;
+  state.tot_iter = context.tot_iter;
+  state.perturb_state = context.perturb_state;
+  state.perturb_iters = context.perturb_iters;
+  state.set_perturb_data = context.set_perturb_data && context.perturb_data;
+  state.set_signal_data = context.set_signal_data && context.signal_data;
+  state.signal_data_params = context.signal_data_params;
+  if (context.params) {
+    state.params = *context.params;
+  }
+
+  FieldWriter config_out;
+  config_fields(config_out, config);
+  FieldWriter state_out;
+  state_fields(state_out, state);
+  std::vector<unsigned char> particle_records(size_t(particles.size()) * record_size);
+  for (int i = 0; i < particles.size(); i++) {
+    pack_particle(particles, i, particle_records.data() + i * record_size);
+  }
+
+  const size_t map_size = map_bytes(w, h, context.map_storage_type);
+  std::vector<PendingSection> sections;
+  sections.push_back({SectionId::Config, config_out.bytes.data(), config_out.bytes.size(), {}});
+  sections.push_back({SectionId::State, state_out.bytes.data(), state_out.bytes.size(), {}});
+  sections.push_back(
+    {SectionId::Particles, particle_records.data(), particle_records.size(), {}});
+  auto add_data = [&](SectionId id, const void* data, size_t size) {
+    if (data) {
+      sections.push_back({id, static_cast<const unsigned char*>(data), size, {}});
+    }
+  };
+  add_data(SectionId::TrailMap, context.texture_data0, map_size);
+  add_data(SectionId::PerturbMap, context.perturb_data, map_size);
+  add_data(SectionId::SignalMap, context.signal_data, map_size);
+  add_data(SectionId::Image, context.rgbau8_texture_data0, size_t(w) * h * 4);
+
+  if (compress) {
+    for (auto& s : sections) {
+      run_length_encode(s.data, s.size, s.encoded);
+      if (s.encoded.size() >= s.size) {
+        s.encoded = {};
+      }
+    }
+  }
+
+  const size_t table_size = sections.size() * sizeof(SectionEntry);
+  std::vector<SectionEntry> table(sections.size());
+  size_t offset = align_up(sizeof(Header) + table_size);
+  for (size_t i = 0; i < sections.size(); i++) {
+    auto& s = sections[i];
+    const bool encoded = !s.encoded.empty();
+    table[i].id = uint32_t(s.id);
+    table[i].encoding = uint32_t(encoded ? SectionEncoding::RunLength : SectionEncoding::Raw);
+    table[i].offset = offset;
+    table[i].stored_size = encoded ? s.encoded.size() : s.size;
+    table[i].size = s.size;
+    offset = align_up(offset + size_t(table[i].stored_size));
+  }
+
+  Header header{};
+  std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+  header.version = checkpoint_version;
+  header.byte_order = byte_order_mark;
+  header.num_sections = uint32_t(sections.size());
+  header.file_size = offset;
+
+  std::vector<unsigned char> result(offset);
+  std::memcpy(result.data(), &header, sizeof(header));
+  std::memcpy(result.data() + sizeof(header), table.data(), table_size);
+  for (size_t i = 0; i < sections.size(); i++) {
+    auto& s = sections[i];
+    const unsigned char* src = s.encoded.empty() ? s.data : s.encoded.data();
+    std::memcpy(result.data() + table[i].offset, src, size_t(table[i].stored_size));
+  }
+  return result;
+}
+
+bool gen::decode_slime_mold_checkpoint(
+  const unsigned char* data, size_t size, SlimeMoldCheckpoint* out) {
+  //
+  Header header{};
+  if (size < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) != 0 ||
+      header.byte_order != byte_order_mark || header.version == 0 ||
+      header.version > checkpoint_version || header.file_size != size ||
+      (size - sizeof(header)) / sizeof(SectionEntry) < header.num_sections) {
+    return false;
+  }
+
+  std::vector<SectionEntry> table(header.num_sections);
+  std::memcpy(table.data(), data + sizeof(header), table.size() * sizeof(SectionEntry));
+  for (auto& entry : table) {
+    if (entry.offset > size || entry.stored_size > size - entry.offset) {
+      return false;
+    }
+  }
+  auto section = [&](SectionId id) {
+    return find_section(table.data(), header.num_sections, id);
+  };
+
+  //  False if the section is missing or too short for its fields.
+  auto fields = [&](SectionId id, auto&& visit) {
+    constexpr uint64_t max_fields_size = 4096;
+    const auto* entry = section(id);
+    if (!entry || entry->size > max_fields_size) {
+      return false;
+    }
+    std::vector<unsigned char> bytes(size_t(entry->size));
+    if (!read_section(data, *entry, bytes.data(), bytes.size())) {
+      return false;
+    }
+    FieldReader reader{bytes.data(), bytes.size()};
+    visit(reader);
+    return reader.ok;
+  };
+
+  State state{};
+  SlimeMoldConfig config;
+  if (!fields(SectionId::State, [&](FieldReader& r) { state_fields(r, state); }) ||
+      !fields(SectionId::Config, [&](FieldReader& r) { config_fields(r, config); })) {
+    return false;
+  }
+  //  Maps are indexed with ints, so the largest (float) map's byte count has to fit one.
+  constexpr size_t max_map_bytes = size_t(std::numeric_limits<int>::max());
+  if (state.width <= 0 || state.height <= 0 ||
+      map_bytes(state.width, state.height, IntegralType::Float) > max_map_bytes ||
+      !is_map_storage_type(state.map_storage_type) ||
+      config.map_storage_type != state.map_storage_type || state.num_particles < 0 ||
+      state.particle_record_size != packed_particle_size()) {
+    return false;
+  }
+
+  const int w = state.width;
+  const int h = state.height;
+  const size_t record_size = packed_particle_size();
+  //  Every section is sized up before anything is allocated for it.
+  const size_t map_size = map_bytes(w, h, state.map_storage_type);
+  const size_t image_size = size_t(w) * h * 4;
+  const auto* particle_entry = section(SectionId::Particles);
+  const auto* trail = section(SectionId::TrailMap);
+  const auto* perturb = section(SectionId::PerturbMap);
+  const auto* signal = section(SectionId::SignalMap);
+  const auto* image = section(SectionId::Image);
+  if (!section_fits(particle_entry, size_t(state.num_particles) * record_size) ||
+      !section_fits(trail, map_size) || (image && !section_fits(image, image_size))) {
+    return false;
+  }
+  SlimeParticles particles;
+  reserve_particles(particles, state.num_particles);
+  particles.num_particles = state.num_particles;
+  {
+    //  Records stored as they are are unpacked straight from `data`.
+    const unsigned char* records = data + particle_entry->offset;
+    std::vector<unsigned char> decoded;
+    if (particle_entry->encoding != uint32_t(SectionEncoding::Raw)) {
+      decoded.resize(size_t(particle_entry->size));
+      if (!read_section(data, *particle_entry, decoded.data(), decoded.size())) {
+        return false;
+      }
+      records = decoded.data();
+    }
+    for (int i = 0; i < state.num_particles; i++) {
+      unpack_particle(records + i * record_size, particles, i);
+    }
+  }
+  particles.turn_rotation_dt = state.turn_rotation_dt;
+
+  auto tex = make_default_slime_mold_texture_data(w, h, state.map_storage_type);
+  if (!read_section(data, *trail, tex.texture_data0.get(), map_size)) {
+    return false;
+  }
+  //  Missing perturb and signal maps are remade on the next step.
+  bool set_perturb_data = state.set_perturb_data;
+  bool set_signal_data = state.set_signal_data;
+  if (!perturb || !read_section(data, *perturb, tex.perturb_data.get(), map_size)) {
+    std::memset(tex.perturb_data.get(), 0, map_size);
+    set_perturb_data = false;
+  }
+  if (!signal || !read_section(data, *signal, tex.signal_data.get(), map_size)) {
+    std::memset(tex.signal_data.get(), 0, map_size);
+    set_signal_data = false;
+  }
+  //  A missing image stays cleared until the next step packs it; a damaged one fails the load.
+  if (image && !read_section(data, *image, tex.rgbau8_texture_data.get(), image_size)) {
+    return false;
+  }
+
+  config.num_particles = state.num_particles;
+  out->config = config;
+  out->params = state.params;
+  out->particles = std::move(particles);
+  out->texture_data = std::move(tex);
+  out->tot_iter = state.tot_iter;
+  out->perturb_state = state.perturb_state;
+  out->perturb_iters = state.perturb_iters;
+  out->set_perturb_data = set_perturb_data;
+  out->set_signal_data = set_signal_data;
+  out->signal_data_params = state.signal_data_params;
+  return true;
+}
+
+bool gen::save_slime_mold_checkpoint(
+  const std::string& file_path, const SlimeParticles& particles, const SlimeMoldConfig& config,
+  const SlimeMoldSimulationContext& context, bool compress) {
+  //
+  const auto bytes = encode_slime_mold_checkpoint(particles, config, context, compress);
+  const auto tmp_path = file_path + ".tmp";
+  FILE* f = std::fopen(tmp_path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  const bool wrote = std::fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size();
+  if (std::fclose(f) != 0 || !wrote) {
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, file_path, ec);
+  return !ec;
+}
+
+bool gen::load_slime_mold_checkpoint(const std::string& file_path, SlimeMoldCheckpoint* out) {
+  size_t size{};
+  if (!fs::file_size(file_path, &size) || size == 0) {
+    return false;
+  }
+  std::vector<unsigned char> bytes(size);
+  size_t read{};
+  if (!fs::read_bytes(file_path, bytes.data(), bytes.size(), &read) || read != size) {
+    return false;
+  }
+  return decode_slime_mold_checkpoint(bytes.data(), bytes.size(), out);
+}
+
+void gen::restore_slime_mold_context_state(
+  const SlimeMoldCheckpoint& checkpoint, SlimeMoldSimulationContext* context) {
+  //
+  context->tot_iter = checkpoint.tot_iter;
+  context->perturb_state = checkpoint.perturb_state;
+  context->perturb_iters = checkpoint.perturb_iters;
+  context->set_perturb_data = checkpoint.set_perturb_data;
+  context->set_signal_data = checkpoint.set_signal_data;
+  context->signal_data_params = checkpoint.signal_data_params;
+}
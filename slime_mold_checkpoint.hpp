@@ -0,0 +1,61 @@
+#pragma once
+
+#include "slime_mold.hpp"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gen {
+
+/*
+ * Everything needed to resume a simulation exactly where it was saved. Random draws are keyed
+ * on `config.seed` and the step count (`tot_iter`), so those two restore the random state as
+ * well. The direction influencing image comes from outside the simulation and is not kept.
+ */
+struct SlimeMoldCheckpoint {
+  SlimeMoldConfig config;
+  SlimeMoldParams params;  //  the context's params when saved
+  SlimeParticles particles;
+  DefaultSlimeMoldSimulationTextureData texture_data;  //  maps and the RGBA8 image
+  uint64_t tot_iter;
+  int perturb_state;
+  int perturb_iters;
+  bool set_perturb_data;
+  bool set_signal_data;
+  SlimeMoldParams signal_data_params;
+};
+
+/*
+ * Checkpoint file layout, in host byte order (a marker in the header rejects the other):
+ *
+ *  - a 64-byte header: magic, format version, section count, file size;
+ *  - a table of sections, each with an id, an encoding, an offset, a stored and a decoded size;
+ *  - the sections, at 64-byte aligned offsets: config, context state, particles (as
+ *    `pack_particle` records), trail, perturb and signal maps and the RGBA8 image.
+ *
+ * With `compress`, a section is run-length encoded when that makes it smaller, which it mostly
+ * does for maps that are still largely empty; sections stored as they are can be used in place
+ * from a mapping of the file. Readers skip sections they do not know, and refuse a newer
+ * version.
+ */
+std::vector<unsigned char> encode_slime_mold_checkpoint(
+  const SlimeParticles& particles, const SlimeMoldConfig& config,
+  const SlimeMoldSimulationContext& context, bool compress = true);
+//  False if `data` is not a complete checkpoint of a version this build reads.
+bool decode_slime_mold_checkpoint(const unsigned char* data, size_t size, SlimeMoldCheckpoint* out);
+
+//  Written to a temporary file and renamed, so a failed save leaves any earlier file whole.
+bool save_slime_mold_checkpoint(
+  const std::string& file_path, const SlimeParticles& particles, const SlimeMoldConfig& config,
+  const SlimeMoldSimulationContext& context, bool compress = true);
+bool load_slime_mold_checkpoint(const std::string& file_path, SlimeMoldCheckpoint* out);
+
+/*
+ * Restores the context's counters and flags from `checkpoint`; the caller points it at the
+ * checkpoint's texture data. A workspace that stepped another map has to `invalidate` its
+ * active tiles.
+ */
+void restore_slime_mold_context_state(
+  const SlimeMoldCheckpoint& checkpoint, SlimeMoldSimulationContext* context);
+
+}
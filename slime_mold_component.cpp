@@ -1,64 +1,163 @@
 #include "slime_mold_component.hpp"
 #include "slime_mold.hpp"
+#include "slime_mold_checkpoint.hpp"
 #include "gui.hpp"
 #include "image_manip.hpp"
 #include "text_rasterizer.hpp"
+#include "triple_buffer.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace {
 
+//  A frame handed from the simulation thread to the renderer.
+struct SimFrame {
+  std::unique_ptr<uint8_t[]> rgbau8;
+  int dim;
+  uint64_t index;  //  0: contents unknown
+  //  Changed since the newest frame known to have been taken before this one was published.
+  gen::ImageDirtyRegion dirty;
+};
+
+//  Dirty regions of the last few frames published, oldest first, by frame index.
+using FrameHistory = std::deque<std::pair<uint64_t, gen::ImageDirtyRegion>>;
+
+
 void set_sim_context_ptrs(
   gen::SlimeMoldSimulationContext& context,
   gen::DefaultSlimeMoldSimulationTextureData& tex_data,
+  gen::ImageDirtyRegion* rgbau8_dirty,
+  gen::SlimeMoldSimulationWorkspace* workspace,
+  gen::ThreadPool* thread_pool,
   const gen::SlimeMoldParams* params,
   const gen::DirectionInfluencingImage* dir_im) {
   //
+  context.map_storage_type = tex_data.map_storage_type;
+  context.texture_width = tex_data.width;
+  context.texture_height = tex_data.height;
   context.texture_data0 = tex_data.texture_data0.get();
-  context.texture_data1 = tex_data.texture_data1.get();
-  context.texture_data2 = tex_data.texture_data2.get();
   context.signal_data = tex_data.signal_data.get();
   context.perturb_data = tex_data.perturb_data.get();
   context.rgbau8_texture_data0 = tex_data.rgbau8_texture_data.get();
+  context.rgbau8_dirty = rgbau8_dirty;
   context.params = params;
   context.direction_influencing_image = dir_im;
+  context.workspace = workspace;
+  context.thread_pool = thread_pool;
+  context.set_signal_data = false;
 }
 
 void init_sim(SlimeMoldComponent& component) {
   auto* impl = &component.sim;
-  impl->texture_data = gen::make_default_slime_mold_texture_data();
+  impl->config.seed = random_seed();
+  impl->texture_data = gen::make_default_slime_mold_texture_data(
+    impl->texture_dim, impl->texture_dim, impl->config.map_storage_type);
   impl->particles = gen::make_slime_mold_particles(impl->config);
+  //  the new image is blank
+  impl->rgbau8_dirty.clear();
+  impl->rgbau8_dirty.add({0, 0, impl->texture_dim, impl->texture_dim});
   set_sim_context_ptrs(
-    impl->sim_context, impl->texture_data,
-    &impl->params, &impl->direction_influencing_image);
+    impl->sim_context, impl->texture_data, &impl->rgbau8_dirty, &impl->workspace,
+    &impl->thread_pool, &impl->params, &impl->direction_influencing_image);
+  impl->telemetry.clear();
+  impl->substepper.owed_s = 0.0;
+  impl->last_frame_time = {};
   impl->initialized = true;
 }
 
-gen::UpdateSlimeMoldParticlesResult update_sim(SlimeMoldComponent& component) {
-  gen::UpdateSlimeMoldParticlesResult res{};
+//  Steps for one frame; false if it took no steps.
+bool update_sim(SlimeMoldComponent& component, gen::UpdateSlimeMoldParticlesResult* res) {
   auto& sim = component.sim;
-  if (sim.initialized) {
-    res = gen::update_slime_mold_particles(
-      sim.particles.get(),
-      sim.config,
-      &sim.sim_context);
+  if (!sim.initialized) {
+    return false;
+  }
+  if (!sim.fixed_timestep) {
+    *res = gen::update_slime_mold_particles(sim.particles, sim.config, &sim.sim_context);
+    return true;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  const float frame_s = sim.last_frame_time == std::chrono::steady_clock::time_point{} ?
+    1.0f / 60.0f : std::chrono::duration<float>(now - sim.last_frame_time).count();
+  sim.last_frame_time = now;
+  *res = gen::update_slime_mold_substeps(
+    sim.particles, sim.config, &sim.sim_context, sim.substepper, frame_s);
+  return sim.substepper.last_num_substeps > 0;
+}
+
+/*
+ * Moves to `level` as the simulation runs: particles are kept or added to, and the trail map is
+ * resampled, where a reinitialize would start over.
+ */
+void set_quality_level(SlimeMoldComponent& component, const gen::QualityLevel& level) {
+  auto& sim = component.sim;
+  gen::set_particle_count(sim.particles, sim.config, level.num_particles);
+  if (level.texture_size != sim.texture_dim) {
+    const int dim = level.texture_size;
+    const auto type = sim.texture_data.map_storage_type;
+    auto tex = gen::make_default_slime_mold_texture_data(dim, dim, type);
+    gen::resample_slime_mold_map(
+      sim.texture_data.texture_data0.get(), sim.texture_data.width, sim.texture_data.height,
+      tex.texture_data0.get(), dim, dim, type);
+    sim.texture_data = std::move(tex);
+    sim.texture_dim = dim;
+    set_sim_context_ptrs(
+      sim.sim_context, sim.texture_data, &sim.rgbau8_dirty, &sim.workspace,
+      &sim.thread_pool, &sim.params, &sim.direction_influencing_image);
+    //  the perturb map is remade from the new trail map
+    sim.sim_context.set_perturb_data = false;
+    sim.workspace.active_tiles.invalidate();
+    sim.rgbau8_dirty.clear();
+    sim.rgbau8_dirty.add({0, 0, dim, dim});
+  }
+  component.params.desired_texture_size = sim.texture_dim;
+  component.params.desired_num_particles = sim.config.num_particles;
+}
+
+void update_quality(SlimeMoldComponent& component, const gen::UpdateSlimeMoldParticlesResult& res) {
+  auto& sim = component.sim;
+  gen::QualityLevel next{};
+  if (component.params.adaptive_quality &&
+      sim.quality.push(res, {sim.texture_dim, sim.particles.size()}, &next)) {
+    set_quality_level(component, next);
   }
-  return res;
+}
+
+//  Union of the dirty regions of frames after `since` up to the newest; false if not known.
+bool changes_since(const FrameHistory& history, uint64_t since, gen::ImageDirtyRegion& out) {
+  if (since == 0 || history.empty() || since + 1 < history.front().first) {
+    return false;
+  }
+  out.clear();
+  for (auto& [index, region] : history) {
+    if (index > since) {
+      for (auto& r : region.rects) {
+        out.add(r);
+      }
+    }
+  }
+  return true;
 }
 
 void set_particle_turn_speed_power(SlimeMoldComponent& comp, int pow) {
   if (comp.sim.initialized) {
-    gen::set_particle_turn_speed_power(comp.sim.particles.get(), comp.sim.config, pow);
+    gen::set_particle_turn_speed_power(comp.sim.particles, comp.sim.config, pow);
   }
 }
 
 void set_particle_speed_power(SlimeMoldComponent& comp, int pow) {
   if (comp.sim.initialized) {
-    gen::set_particle_speed_power(comp.sim.particles.get(), comp.sim.config, pow);
+    gen::set_particle_speed_power(comp.sim.particles, comp.sim.config, pow);
   }
 }
 
 void set_particle_use_only_right_turns(SlimeMoldComponent& comp, bool v) {
   if (comp.sim.initialized) {
-    gen::set_particle_right_only(comp.sim.particles.get(), comp.sim.config, v);
+    gen::set_particle_right_only(comp.sim.particles, comp.sim.config, v);
   }
 }
 
@@ -163,8 +262,13 @@ void try_update_direction_influencing_image(
   }
 #endif
 
+  auto dir_im_v = std::make_unique<Vec2f[]>(rd * rd);
+  for (int i = 0; i < rd * rd; i++) {
+    dir_im_v[i] = Vec2f{std::cos(dir_im_f[i]), std::sin(dir_im_f[i])};
+  }
+
   auto& dir_im = comp.sim.direction_influencing_image;
-  dir_im.theta = std::move(dir_im_f);
+  dir_im.direction = std::move(dir_im_v);
   dir_im.w = rd;
   dir_im.h = rd;
   comp.sim.direction_influencing_src_image = std::move(im_gray);
@@ -172,12 +276,123 @@ void try_update_direction_influencing_image(
 
 } //  anon
 
+struct SlimeMoldComponent::SimThread {
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool stop{};
+  std::vector<GUIUpdateResult> pending;
+  gen::TripleBuffer<SimFrame> frames;
+  FrameHistory history;
+  gen::ImageDirtyRegion copy_region;
+  uint64_t num_published{};
+  uint64_t last_taken{};  //  0: none known
+};
+
+namespace {
+
+/*
+ * Brings the back frame up to date with `image` by copying what changed since the frame it last
+ * held, and publishes it with what changed since the newest frame the renderer is known to have
+ * taken; if it took a later one meanwhile, re-uploading a little more is harmless.
+ */
+void publish_frame(
+  SlimeMoldComponent::SimThread& st, const uint8_t* image, int dim,
+  gen::ImageDirtyRegion& dirty) {
+  //
+  constexpr int max_history = 8;
+  const uint64_t index = ++st.num_published;
+  st.history.emplace_back(index, dirty);
+  dirty.clear();
+  if (int(st.history.size()) > max_history) {
+    st.history.pop_front();
+  }
+  if (!st.frames.pending()) {
+    st.last_taken = index - 1;
+  }
+
+  auto& frame = st.frames.back();
+  const gen::ImageDirtyRegion::Rect full{0, 0, dim, dim};
+  if (frame.dim != dim || !frame.rgbau8) {
+    frame.rgbau8 = std::make_unique<uint8_t[]>(size_t(dim) * dim * 4);
+    frame.dim = dim;
+    frame.index = 0;
+  }
+
+  auto& copy = st.copy_region;
+  if (!changes_since(st.history, frame.index, copy)) {
+    copy.clear();
+    copy.add(full);
+  }
+  for (auto& r : copy.rects) {
+    const int x0 = std::max(0, r.x0);
+    const int x1 = std::min(dim, r.x1);
+    for (int y = std::max(0, r.y0); y < std::min(dim, r.y1) && x1 > x0; y++) {
+      const size_t off = (size_t(y) * dim + x0) * 4;
+      std::memcpy(frame.rgbau8.get() + off, image + off, size_t(x1 - x0) * 4);
+    }
+  }
+
+  if (!changes_since(st.history, st.last_taken, frame.dirty)) {
+    frame.dirty.clear();
+    frame.dirty.add(full);
+  }
+  frame.index = index;
+  st.frames.publish();
+}
+
+} //  anon
+
+SlimeMoldComponent::SlimeMoldComponent() = default;
+
+SlimeMoldComponent::~SlimeMoldComponent() {
+  stop_sim_thread();
+}
+
 void SlimeMoldComponent::reinitialize() {
   params.need_reinitialize = true;
 }
 
+bool SlimeMoldComponent::save_checkpoint(const std::string& file_path) const {
+  return sim.initialized && gen::save_slime_mold_checkpoint(
+    file_path, sim.particles, sim.config, sim.sim_context);
+}
+
+bool SlimeMoldComponent::load_checkpoint(const std::string& file_path) {
+  gen::SlimeMoldCheckpoint checkpoint{};
+  if (!gen::load_slime_mold_checkpoint(file_path, &checkpoint) ||
+      checkpoint.texture_data.width != checkpoint.texture_data.height) {
+    return false;
+  }
+  //  the thread count suits this machine, not the one that saved
+  checkpoint.config.num_threads = sim.config.num_threads;
+  sim.config = checkpoint.config;
+  sim.params = checkpoint.params;
+  sim.particles = std::move(checkpoint.particles);
+  sim.texture_data = std::move(checkpoint.texture_data);
+  sim.texture_dim = sim.texture_data.width;
+  set_sim_context_ptrs(
+    sim.sim_context, sim.texture_data, &sim.rgbau8_dirty, &sim.workspace,
+    &sim.thread_pool, &sim.params, &sim.direction_influencing_image);
+  gen::restore_slime_mold_context_state(checkpoint, &sim.sim_context);
+  sim.workspace.active_tiles.invalidate();
+  sim.rgbau8_dirty.clear();
+  sim.rgbau8_dirty.add({0, 0, sim.texture_dim, sim.texture_dim});
+  sim.telemetry.clear();
+  sim.substepper.owed_s = 0.0;
+  sim.last_frame_time = {};
+  sim.quality.reset();
+  sim.initialized = true;
+
+  params.initialized = true;
+  params.need_reinitialize = false;
+  params.desired_texture_size = sim.texture_dim;
+  params.desired_num_particles = sim.config.num_particles;
+  return true;
+}
+
 int SlimeMoldComponent::get_texture_dim() const {
-  return gen::SlimeMoldConfig::texture_dim;
+  return sim.texture_dim;
 }
 
 int SlimeMoldComponent::get_current_num_particles() const {
@@ -189,17 +404,114 @@ const uint8_t* SlimeMoldComponent::read_r_dir_image_data(int* dim) const {
   return sim.direction_influencing_src_image.get();
 }
 
-const uint8_t* SlimeMoldComponent::read_rgbau8_image_data() const {
+const uint8_t* SlimeMoldComponent::read_rgbau8_image_data(int* dim) const {
+  if (sim_thread) {
+    const auto& frame = sim_thread->frames.front();
+    *dim = frame.rgbau8 ? frame.dim : sim.texture_dim;
+    return frame.rgbau8.get();
+  }
+  *dim = sim.texture_dim;
   return sim.texture_data.rgbau8_texture_data.get();
 }
 
-gen::UpdateSlimeMoldParticlesResult SlimeMoldComponent::update() {
+const gen::ImageDirtyRegion& SlimeMoldComponent::read_rgbau8_dirty_region() const {
+  return sim_thread ? sim_thread->frames.front().dirty : sim.rgbau8_dirty;
+}
+
+void SlimeMoldComponent::clear_rgbau8_dirty_region() {
+  if (sim_thread) {
+    sim_thread->frames.front().dirty.clear();
+  } else {
+    sim.rgbau8_dirty.clear();
+  }
+}
+
+void SlimeMoldComponent::start_sim_thread() {
+#if SM_THREADS_ENABLED
+  if (!sim_thread) {
+    sim_thread = std::make_unique<SimThread>();
+    sim_thread->thread = std::thread([this]() {
+      run_sim_thread();
+    });
+  }
+#endif
+}
+
+void SlimeMoldComponent::stop_sim_thread() {
+  if (!sim_thread) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock{sim_thread->mutex};
+    sim_thread->stop = true;
+  }
+  sim_thread->cv.notify_one();
+  sim_thread->thread.join();
+  for (auto& res : sim_thread->pending) {
+    apply_gui_update(res);
+  }
+  sim_thread.reset();
+  //  the renderer holds an older frame than the simulation's image
+  sim.rgbau8_dirty.add({0, 0, sim.texture_dim, sim.texture_dim});
+}
+
+bool SlimeMoldComponent::sim_thread_running() const {
+  return sim_thread != nullptr;
+}
+
+std::unique_lock<std::mutex> SlimeMoldComponent::lock_shared_state() {
+  return sim_thread ?
+    std::unique_lock<std::mutex>{sim_thread->mutex} : std::unique_lock<std::mutex>{};
+}
+
+void SlimeMoldComponent::take_frame() {
+  if (sim_thread && sim_thread->frames.take()) {
+    sim_thread->cv.notify_one();
+  }
+}
+
+void SlimeMoldComponent::run_sim_thread() {
+  auto& st = *sim_thread;
+  while (true) {
+    bool step{};
+    {
+      std::unique_lock<std::mutex> lock{st.mutex};
+      //  Frames are taken without the mutex, so a wakeup can be missed; the timeout bounds the
+      //  delay that causes.
+      st.cv.wait_for(lock, std::chrono::milliseconds(4), [&]() {
+        return st.stop || !st.pending.empty() || (params.enabled && !st.frames.pending());
+      });
+      if (st.stop) {
+        return;
+      }
+      for (auto& res : st.pending) {
+        apply_gui_update(res);
+      }
+      st.pending.clear();
+      step = prepare_step() && !st.frames.pending();
+    }
+
+    gen::UpdateSlimeMoldParticlesResult res{};
+    if (step && update_sim(*this, &res)) {
+      std::lock_guard<std::mutex> lock{st.mutex};
+      sim.telemetry.push(res);
+      sim.last_num_substeps = sim.substepper.last_num_substeps;
+      update_quality(*this, res);
+    }
+    //  A frame that took no steps is still published, so steps keep pace with frames taken.
+    if (step || !sim.rgbau8_dirty.empty()) {
+      publish_frame(
+        st, sim.texture_data.rgbau8_texture_data.get(), sim.texture_dim, sim.rgbau8_dirty);
+    }
+  }
+}
+
+//  Makes or remakes the simulation as requested; true if it should step.
+bool SlimeMoldComponent::prepare_step() {
   if (params.initialized && params.need_reinitialize) {
-#if DYNAMIC_TEXTURE_SIZE
     if (params.desired_texture_size > 0) {
-      gen::SlimeMoldConfig::texture_dim = params.desired_texture_size;
+      sim.texture_dim = params.desired_texture_size;
     }
-#endif
     const int curr_num_particles = sim.config.num_particles;
     sim.config.num_particles = params.desired_num_particles > 0 ?
       params.desired_num_particles : curr_num_particles;
@@ -207,18 +519,42 @@ gen::UpdateSlimeMoldParticlesResult SlimeMoldComponent::update() {
     params.need_reinitialize = false;
   }
 
+  if (params.enabled && !params.initialized) {
+    init_sim(*this);
+    params.initialized = true;
+  }
+  return params.enabled;
+}
+
+gen::UpdateSlimeMoldParticlesResult SlimeMoldComponent::update() {
   gen::UpdateSlimeMoldParticlesResult res{};
-  if (params.enabled) {
-    if (!params.initialized) {
-      init_sim(*this);
-      params.initialized = true;
-    }
-    res = update_sim(*this);
+  if (!sim_thread && prepare_step() && update_sim(*this, &res)) {
+    sim.telemetry.push(res);
+    sim.last_num_substeps = sim.substepper.last_num_substeps;
+    update_quality(*this, res);
   }
   return res;
 }
 
 void SlimeMoldComponent::on_gui_update(const GUIUpdateResult& res) {
+  if (res.sim_thread && !res.sim_thread.value()) {
+    stop_sim_thread();
+  }
+  if (sim_thread) {
+    {
+      std::lock_guard<std::mutex> lock{sim_thread->mutex};
+      sim_thread->pending.push_back(res);
+    }
+    sim_thread->cv.notify_one();
+  } else {
+    apply_gui_update(res);
+  }
+  if (res.sim_thread && res.sim_thread.value()) {
+    start_sim_thread();
+  }
+}
+
+void SlimeMoldComponent::apply_gui_update(const GUIUpdateResult& res) {
   if (res.enabled) {
     params.enabled = res.enabled.value();
   }
@@ -241,6 +577,17 @@ void SlimeMoldComponent::on_gui_update(const GUIUpdateResult& res) {
   if (res.time_scale) {
     config->time_scale = res.time_scale.value();
   }
+  if (res.fixed_timestep) {
+    sim.fixed_timestep = res.fixed_timestep.value();
+    sim.substepper.owed_s = 0.0;
+    sim.last_frame_time = {};
+  }
+  if (res.substep_budget_ms) {
+    sim.substepper.budget_ms = res.substep_budget_ms.value();
+  }
+  if (res.max_substeps) {
+    sim.substepper.max_substeps = res.max_substeps.value();
+  }
   if (res.only_right_turns) {
     config->only_right_turns = res.only_right_turns.value();
   }
@@ -256,9 +603,23 @@ void SlimeMoldComponent::on_gui_update(const GUIUpdateResult& res) {
   if (res.average_image) {
     config->average_image = res.average_image.value();
   }
+  if (res.summed_area_sensing) {
+    config->summed_area_sensing = res.summed_area_sensing.value();
+  }
+  if (res.post_step_stage_timing) {
+    config->post_step_stage_timing = res.post_step_stage_timing.value();
+  }
   if (res.reset_diffuse_parameters) {
     config->reset_diffuse_parameters();
   }
+  if (res.adaptive_quality) {
+    params.adaptive_quality = res.adaptive_quality.value();
+    sim.quality.reset();
+  }
+  if (res.quality_target_ms) {
+    sim.quality.target_ms = res.quality_target_ms.value();
+    sim.quality.reset();
+  }
   if (res.new_num_particles) {
     params.desired_num_particles = res.new_num_particles.value();
     params.need_reinitialize = true;
@@ -267,9 +628,19 @@ void SlimeMoldComponent::on_gui_update(const GUIUpdateResult& res) {
     params.desired_texture_size = res.new_texture_size.value();
     params.need_reinitialize = true;
   }
+  if (res.new_map_storage_type) {
+    config->map_storage_type = res.new_map_storage_type.value();
+    params.need_reinitialize = true;
+  }
   if (res.reinitialize) {
     params.need_reinitialize = true;
   }
+  if (res.save_checkpoint_path) {
+    save_checkpoint(res.save_checkpoint_path.value());
+  }
+  if (res.load_checkpoint_path) {
+    load_checkpoint(res.load_checkpoint_path.value());
+  }
 
   bool need_update_dir_image{};
   if (res.overlay_text) {
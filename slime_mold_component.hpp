@@ -1,6 +1,12 @@
 #pragma once
 
 #include "slime_mold.hpp"
+#include "adaptive_quality.hpp"
+#include "slime_mold_telemetry.hpp"
+#include "thread_pool.hpp"
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <string>
 
 struct GUIUpdateResult;
@@ -14,6 +20,8 @@ public:
     int desired_num_particles{};
     int desired_texture_size{};
     int edge_detection_threshold{13};
+    //  Resize the map and particle set as they run to hold a time per frame; see AdaptiveQuality.
+    bool adaptive_quality{};
     std::string overlay_text;
     std::string direction_influencing_image_path;
   };
@@ -23,22 +31,75 @@ public:
     gen::SlimeMoldConfig config;
     gen::SlimeMoldSimulationContext sim_context{};
     gen::DefaultSlimeMoldSimulationTextureData texture_data;
-    std::unique_ptr<gen::SlimeParticle[]> particles;
+    gen::ImageDirtyRegion rgbau8_dirty;
+    gen::SlimeMoldSimulationWorkspace workspace;
+    gen::ThreadPool thread_pool;
+    int texture_dim{DEFAULT_TEXTURE_SIZE};
+    gen::SlimeParticles particles;
+    gen::SimTelemetry telemetry;
+    //  Steps at a fixed rate in real time, as many per frame as the time scale asks for; otherwise
+    //  one step per frame, of a length that scales with it.
+    bool fixed_timestep{true};
+    gen::SlimeMoldSubstepper substepper;
+    //  The substepper's count for the last frame, copied where the GUI may read it.
+    int last_num_substeps{};
+    std::chrono::steady_clock::time_point last_frame_time{};
+    gen::AdaptiveQuality quality;
     gen::DirectionInfluencingImage direction_influencing_image{};
     std::unique_ptr<uint8_t[]> direction_influencing_src_image;
     bool initialized{};
   };
 
+  struct SimThread;
+
 public:
+  SlimeMoldComponent();
+  ~SlimeMoldComponent();
+
   void reinitialize();
+  /*
+   * The whole simulation state, in the format of gen::save_slime_mold_checkpoint. Loading
+   * replaces the simulation, as a reinitialize would, but with the saved one. Not while the
+   * simulation thread runs: requests through `on_gui_update` are carried out between its steps.
+   */
+  bool save_checkpoint(const std::string& file_path) const;
+  bool load_checkpoint(const std::string& file_path);
   gen::UpdateSlimeMoldParticlesResult update();
   void on_gui_update(const GUIUpdateResult& res);
   int get_texture_dim() const;
   int get_current_num_particles() const;
-  const uint8_t* read_rgbau8_image_data() const;
+
+  /*
+   * Steps the simulation on a thread of its own, at most one step ahead of the frames taken with
+   * `take_frame`, so a step overlaps the render of the previous one. Meanwhile `update` does
+   * nothing and `on_gui_update` hands changes over to the thread, which applies them between
+   * steps; anything else reading the component has to hold `lock_shared_state`. No-op without
+   * thread support.
+   */
+  void start_sim_thread();
+  void stop_sim_thread();
+  bool sim_thread_running() const;
+  //  Holds off the simulation thread's changes to the component, if it is running.
+  std::unique_lock<std::mutex> lock_shared_state();
+  //  Moves to the newest frame the simulation thread finished, if any; no-op without the thread.
+  void take_frame();
+
+  //  `dim` x `dim` pixels: the simulation's own image, or the frame last taken.
+  const uint8_t* read_rgbau8_image_data(int* dim) const;
+  //  Parts of that image changed since the last `clear_rgbau8_dirty_region`.
+  const gen::ImageDirtyRegion& read_rgbau8_dirty_region() const;
+  void clear_rgbau8_dirty_region();
   const uint8_t* read_r_dir_image_data(int* dim) const;
 
+private:
+  void apply_gui_update(const GUIUpdateResult& res);
+  bool prepare_step();
+  void run_sim_thread();
+
 public:
   Params params;
   Sim sim;
+
+private:
+  std::unique_ptr<SimThread> sim_thread;
 };
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "slime_mold_ensemble.hpp"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+using namespace gen;
+
+//  Relative cost of one step: the post-step passes scale with texels, update and deposit with
+//  particles.
+double step_cost(const SlimeMoldEnsembleMember& member) {
+  return double(member.texture_data.width) * double(member.texture_data.height) +
+         2.0 * double(member.particles.size());
+}
+
+void set_context_ptrs(SlimeMoldEnsembleMember& member) {
+  auto& context = member.context;
+  auto& tex_data = member.texture_data;
+  context.map_storage_type = tex_data.map_storage_type;
+  context.texture_width = tex_data.width;
+  context.texture_height = tex_data.height;
+  context.texture_data0 = tex_data.texture_data0.get();
+  context.perturb_data = tex_data.perturb_data.get();
+  context.signal_data = tex_data.signal_data.get();
+  context.rgbau8_texture_data0 = tex_data.rgbau8_texture_data.get();
+  context.params = &member.params;
+  context.direction_influencing_image = &member.direction_influencing_image;
+  context.workspace = &member.workspace;
+}
+
+void step_member(SlimeMoldEnsembleMember& member, ThreadPool* pool, int num_steps) {
+  member.context.thread_pool = pool;
+  member.config.num_threads = pool ? pool->num_threads() : 1;
+  for (int i = 0; i < num_steps; i++) {
+    member.last_result = update_slime_mold_particles(
+      member.particles, member.config, &member.context);
+    member.total_ms += member.last_result.dt_ms;
+  }
+}
+
+} //  anon
+
+gen::SlimeMoldEnsemble::SlimeMoldEnsemble(int num_threads) {
+  set_num_threads(num_threads);
+}
+
+void gen::SlimeMoldEnsemble::set_num_threads(int num_threads) {
+  pool.set_num_threads(num_threads);
+  batches_stale = true;
+}
+
+int gen::SlimeMoldEnsemble::num_threads() const {
+  return pool.num_threads();
+}
+
+int gen::SlimeMoldEnsemble::add(
+  const SlimeMoldConfig& config, int width, int height, const SlimeMoldParams& params) {
+  //
+  auto member = std::make_unique<SlimeMoldEnsembleMember>();
+  member->config = config;
+  member->params = params;
+  member->texture_data = make_default_slime_mold_texture_data(
+    width, height, config.map_storage_type);
+  member->particles = make_slime_mold_particles(config);
+  set_context_ptrs(*member);
+  members.push_back(std::move(member));
+  batches_stale = true;
+  return size() - 1;
+}
+
+void gen::SlimeMoldEnsemble::clear() {
+  members.clear();
+  batches_stale = true;
+}
+
+int gen::SlimeMoldEnsemble::num_batches() {
+  if (batches_stale) {
+    plan_batches();
+  }
+  return int(batch_offsets.size()) - 1;
+}
+
+/*
+ * Aims for about four batches per thread. Members are taken from most to least costly; one that
+ * costs at least a batch's share is a batch of its own, and the rest are packed in order until
+ * each batch reaches its share. Batches come out roughly in decreasing cost, so handing them out
+ * in order balances the threads.
+ */
+void gen::SlimeMoldEnsemble::plan_batches() {
+  batch_members.resize(members.size());
+  std::iota(batch_members.begin(), batch_members.end(), 0);
+  std::vector<double> costs(members.size());
+  double total{};
+  for (int i = 0; i < size(); i++) {
+    costs[i] = step_cost(*members[i]);
+    total += costs[i];
+  }
+  std::stable_sort(batch_members.begin(), batch_members.end(), [&](int a, int b) {
+    return costs[a] > costs[b];
+  });
+
+  const double share = total / double(pool.num_threads() * 4);
+  batch_offsets.assign(1, 0);
+  double batch_cost{};
+  for (int i = 0; i < size(); i++) {
+    batch_cost += costs[batch_members[i]];
+    if (batch_cost >= share || i + 1 == size()) {
+      batch_offsets.push_back(i + 1);
+      batch_cost = 0.0;
+    }
+  }
+  batches_stale = false;
+}
+
+void gen::SlimeMoldEnsemble::step(int num_steps) {
+  if (members.empty() || num_steps <= 0) {
+    return;
+  }
+
+  const int nb = num_batches();
+  if (nb >= pool.num_threads() && pool.num_threads() > 1) {
+    pool.parallel_for(nb, [&](int b) {
+      for (int k = batch_offsets[b]; k < batch_offsets[b + 1]; k++) {
+        step_member(*members[batch_members[k]], nullptr, num_steps);
+      }
+    });
+  } else {
+    for (auto& member : members) {
+      step_member(*member, &pool, num_steps);
+    }
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "slime_mold.hpp"
+#include "thread_pool.hpp"
+#include <memory>
+#include <vector>
+
+namespace gen {
+
+//  One simulation of an ensemble: its config and every piece of state a step touches.
+struct SlimeMoldEnsembleMember {
+  SlimeMoldConfig config;
+  SlimeMoldParams params;
+  DefaultSlimeMoldSimulationTextureData texture_data;
+  SlimeParticles particles;
+  DirectionInfluencingImage direction_influencing_image{};
+  SlimeMoldSimulationWorkspace workspace;
+  SlimeMoldSimulationContext context{};
+  UpdateSlimeMoldParticlesResult last_result{};
+  double total_ms{};  //  `dt_ms` summed over every step taken
+};
+
+/*
+ * Owns K independent simulations and steps them together on one thread pool.
+ *
+ * When there are at least as many batches of work as threads, each simulation steps serially
+ * and whole simulations are spread over the threads: small maps are packed into batches of
+ * about equal cost, and a batch runs all of its steps back to back, so a map stays in cache
+ * across steps and the per-task cost is paid once per batch rather than once per simulation
+ * step. Otherwise the simulations step one after another, each using the whole pool.
+ *
+ * Members are reproducible from their configs (seed included) whichever way they are scheduled.
+ * The ensemble sets each member's `num_threads`.
+ */
+class SlimeMoldEnsemble {
+public:
+  SlimeMoldEnsemble() = default;
+  explicit SlimeMoldEnsemble(int num_threads);
+
+  //  <= 0: one per hardware thread.
+  void set_num_threads(int num_threads);
+  int num_threads() const;
+
+  //  Returns the new member's index.
+  int add(
+    const SlimeMoldConfig& config, int width, int height, const SlimeMoldParams& params = {});
+  void clear();
+  int size() const {
+    return int(members.size());
+  }
+  SlimeMoldEnsembleMember& member(int i) {
+    return *members[i];
+  }
+  const SlimeMoldEnsembleMember& member(int i) const {
+    return *members[i];
+  }
+  int num_batches();
+
+  //  Advances every member by `num_steps` steps.
+  void step(int num_steps = 1);
+
+private:
+  void plan_batches();
+
+private:
+  ThreadPool pool;
+  std::vector<std::unique_ptr<SlimeMoldEnsembleMember>> members;
+  //  Members of batch b are batch_members[batch_offsets[b], batch_offsets[b + 1]).
+  std::vector<int> batch_members;
+  std::vector<int> batch_offsets;
+  bool batches_stale{true};
+};
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "slime_mold.hpp"
+#include "map_storage.hpp"
+
+namespace gen {
+
+class ThreadPool;
+
+/*
+ * Single stages of `update_slime_mold_particles`, so they can be timed on their own. Maps hold
+ * float texels unless noted; `pool` may be null.
+ */
+namespace kernels {
+
+//  Sense and move; SIMD per `config.simd_update_enabled`.
+void update_particles(
+  const SlimeMoldConfig& config, SlimeParticles& parts, MapView<const float> map,
+  ThreadPool* pool);
+Vec3f sense(MapView<const float> map, const Vec2f& p, float win_size);
+Vec3f sense_circular(MapView<const float> map, const Vec2f& p, float win_size);
+void deposit_particles(
+  const SlimeParticles& parts, MapView<float> map, ThreadPool* pool,
+  SlimeMoldSimulationWorkspace& ws);
+void box_filter(MapView<const float> map, MapView<float> out, MapView<float> tmp, int filter_size);
+
+//  The fused post-deposit pass with any subset of its stages.
+struct PostStepStages {
+  bool diffuse;
+  int filter_size;
+  float diffuse_speed;
+  float decay;
+  const float* signal;  //  optional, same size as the map; applied over the whole map
+  const float* perturb;  //  optional, same size as the map
+  bool average;
+  uint8_t* rgbau8;  //  optional
+  //  Tile kernels only: texels [pack_x0, pack_x1) x [pack_y0, pack_y1) of the map pack to
+  //  `rgbau8`, texel (pack_x0, pack_y0) to its first pixel and rows `rgbau8_stride` pixels apart.
+  int pack_x0;
+  int pack_y0;
+  int pack_x1;
+  int pack_y1;
+  int rgbau8_stride;
+  //  Tile kernels only: diffuse in a pass of its own, so the other stages and the pack see the
+  //  stored texels, as `update_slime_mold_particles` does on a step that makes a perturbation map.
+  bool diffuse_first;
+};
+
+void post_step(
+  const PostStepStages& stages, MapView<float> map, ThreadPool* pool,
+  SlimeMoldSimulationWorkspace& ws);
+
+/*
+ * Serial stages over one tile of a larger map, for engines that step a map as tiles (see
+ * slime_mold_tiled.hpp), with T float, Half or Unorm16. The window must hold every texel the
+ * particles sense or deposit into.
+ */
+//  Particle i of `parts` draws its bounce heading from stream `first_index + i * index_stride`;
+//  keep those unique over every tile stepped at `step`.
+template <typename T>
+void update_particles(
+  const SlimeMoldConfig& config, SlimeParticles& parts, MapWindowView<const T> map,
+  const DirectionInfluencingImage& dir_im, uint32_t step, uint32_t first_index,
+  uint32_t index_stride);
+template <typename T>
+void deposit_particles(const SlimeParticles& parts, MapWindowView<T> map);
+//  Diffuse, decay, average and pack; the signal and perturb stages are ignored. Texels pack
+//  from the float rows before they are stored back, as in `update_slime_mold_particles`. With
+//  `pack_ms`, also the part of the pass spent packing.
+template <typename T>
+void post_step(
+  const PostStepStages& stages, MapView<T> map, SlimeMoldSimulationWorkspace& ws,
+  float* pack_ms = nullptr);
+
+}
+
+}
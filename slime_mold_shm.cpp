@@ -0,0 +1,463 @@
+#include "slime_mold_shm.hpp"
+#include "slime_mold_tiled.hpp"
+#include "slime_mold_kernels.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gen {
+
+//  Sense-reversing barrier; lock-free atomics work across processes.
+struct ProcessBarrier {
+  std::atomic<uint32_t> arrived;
+  std::atomic<uint32_t> generation;
+  uint32_t count;
+};
+
+struct BandSegmentHeader {
+  uint64_t magic;
+  SlimeMoldConfig config;
+  int width;
+  int height;
+  int num_bands;
+  int halo;
+  int outbox_capacity;  //  records per band per round
+  int record_size;  //  band index, then the packed particle
+  size_t image_offset;
+  size_t slots_offset;
+  size_t slot_size;
+  size_t edge_size;  //  `halo` rows of one band
+  ProcessBarrier barrier;
+  std::atomic<int> aborted;
+};
+
+}
+
+namespace {
+
+using namespace gen;
+
+constexpr uint64_t band_segment_magic = 0x534d42414e443031ull;  //  "SMBAND01"
+constexpr size_t segment_alignment = 64;
+
+//  Start of each band's slot: its outbox count and whether it has more records than fit.
+struct BandSlotHeader {
+  int outbox_count;
+  int more;
+};
+
+size_t align_up(size_t n) {
+  return (n + segment_alignment - 1) / segment_alignment * segment_alignment;
+}
+
+size_t map_element_bytes(IntegralType type) {
+  return type == IntegralType::Float ? sizeof(float) : sizeof(uint16_t);
+}
+
+//  Rows [band_row(b), band_row(b + 1)) belong to band b.
+int band_row(int b, int num_bands, int height) {
+  return int(int64_t(b) * height / num_bands);
+}
+
+//  Slot layout: header, top edge, bottom edge, outbox.
+size_t slot_edges_offset() {
+  return align_up(sizeof(BandSlotHeader));
+}
+
+size_t slot_outbox_offset(size_t edge_size) {
+  return slot_edges_offset() + 2 * edge_size;
+}
+
+double elapsed_ms(std::chrono::high_resolution_clock::time_point t0) {
+  return std::chrono::duration<double>(
+    std::chrono::high_resolution_clock::now() - t0).count() * 1e3;
+}
+
+} //  anon
+
+gen::SharedMemorySegment::~SharedMemorySegment() {
+  unmap();
+}
+
+void gen::SharedMemorySegment::unmap() {
+  if (ptr) {
+    munmap(ptr, bytes);
+    ptr = nullptr;
+    bytes = 0;
+  }
+}
+
+bool gen::SharedMemorySegment::create(const std::string& seg_name, size_t size) {
+  unmap();
+  shm_unlink(seg_name.c_str());
+  const int fd = shm_open(seg_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  void* p = MAP_FAILED;
+  if (ftruncate(fd, off_t(size)) == 0) {
+    p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(seg_name.c_str());
+    return false;
+  }
+  name = seg_name;
+  ptr = static_cast<unsigned char*>(p);
+  bytes = size;
+  return true;
+}
+
+bool gen::SharedMemorySegment::open(const std::string& seg_name) {
+  unmap();
+  const int fd = shm_open(seg_name.c_str(), O_RDWR, 0600);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st{};
+  void* p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    p = mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  name = seg_name;
+  ptr = static_cast<unsigned char*>(p);
+  bytes = size_t(st.st_size);
+  return true;
+}
+
+void gen::SharedMemorySegment::unlink() {
+  if (!name.empty()) {
+    shm_unlink(name.c_str());
+  }
+}
+
+bool gen::SlimeMoldBandProcess::init_segment(
+  SharedMemorySegment& segment, const std::string& name, const SlimeMoldConfig& config,
+  int width, int height, int num_bands) {
+  //
+  if (num_bands <= 0 || width <= 0 || height <= 0) {
+    return false;
+  }
+  const auto particles = make_slime_mold_particles(config);
+  const int halo = tile_halo_width(config, particles, width, height);
+  for (int b = 0; b < num_bands; b++) {
+    if (band_row(b + 1, num_bands, height) - band_row(b, num_bands, height) < halo) {
+      return false;
+    }
+  }
+
+  const int outbox_capacity = 4096 + config.num_particles / (16 * num_bands);
+  const int record_size = int(sizeof(int) + packed_particle_size());
+  const size_t edge_size = align_up(
+    size_t(halo) * width * MapView<float>::channels * map_element_bytes(config.map_storage_type));
+  const size_t slot_size = align_up(
+    slot_outbox_offset(edge_size) + size_t(outbox_capacity) * record_size);
+  const size_t image_offset = align_up(sizeof(BandSegmentHeader));
+  const size_t slots_offset = image_offset + align_up(size_t(width) * height * 4);
+  if (!segment.create(name, slots_offset + slot_size * num_bands)) {
+    return false;
+  }
+
+  auto* header = new (segment.data()) BandSegmentHeader{};
+  header->magic = band_segment_magic;
+  header->config = config;
+  header->width = width;
+  header->height = height;
+  header->num_bands = num_bands;
+  header->halo = halo;
+  header->outbox_capacity = outbox_capacity;
+  header->record_size = record_size;
+  header->image_offset = image_offset;
+  header->slots_offset = slots_offset;
+  header->slot_size = slot_size;
+  header->edge_size = edge_size;
+  header->barrier.count = uint32_t(num_bands);
+  return true;
+}
+
+void gen::SlimeMoldBandProcess::abort(SharedMemorySegment& segment) {
+  auto* header = reinterpret_cast<BandSegmentHeader*>(segment.data());
+  header->aborted.store(1, std::memory_order_release);
+}
+
+gen::SlimeMoldBandProcess::SlimeMoldBandProcess(SharedMemorySegment& segment, int rank) :
+  header{reinterpret_cast<BandSegmentHeader*>(segment.data())}, rank{rank} {
+  //
+  assert(header->magic == band_segment_magic && rank >= 0 && rank < header->num_bands);
+  const auto& config = header->config;
+  y0 = band_row(rank, header->num_bands, header->height);
+  y1 = band_row(rank + 1, header->num_bands, header->height);
+  map = make_slime_mold_map_data(
+    header->width, y1 - y0 + 2 * header->halo, config.map_storage_type);
+
+  //  Every band makes the same particles and keeps its own.
+  const auto all = make_slime_mold_particles(config);
+  particle_capacity = std::max(64, all.size() / header->num_bands);
+  reserve_particles(particles, particle_capacity);
+  for (int i = 0; i < all.size(); i++) {
+    if (band_of(all.position_y[i]) == rank) {
+      if (particles.size() == particle_capacity) {
+        particle_capacity += particle_capacity / 2;
+        reserve_particles(particles, particle_capacity);
+      }
+      copy_particle(all, i, particles, particles.num_particles++);
+    }
+  }
+}
+
+const SlimeMoldConfig& gen::SlimeMoldBandProcess::get_config() const {
+  return header->config;
+}
+
+int gen::SlimeMoldBandProcess::width() const {
+  return header->width;
+}
+
+int gen::SlimeMoldBandProcess::height() const {
+  return header->height;
+}
+
+int gen::SlimeMoldBandProcess::num_bands() const {
+  return header->num_bands;
+}
+
+int gen::SlimeMoldBandProcess::halo_size() const {
+  return header->halo;
+}
+
+const uint8_t* gen::SlimeMoldBandProcess::read_rgbau8_image_data() const {
+  return reinterpret_cast<const uint8_t*>(header) + header->image_offset;
+}
+
+unsigned char* gen::SlimeMoldBandProcess::slot(int band) const {
+  return reinterpret_cast<unsigned char*>(header) + header->slots_offset +
+    header->slot_size * band;
+}
+
+//  Same row as `deposit` picks, so a particle always deposits into its own band.
+int gen::SlimeMoldBandProcess::band_of(float y) const {
+  const int h = header->height;
+  const int j = std::clamp(int(std::floor(y * float(h))), 0, h - 1);
+  int b = std::min(header->num_bands - 1, int(int64_t(j) * header->num_bands / h));
+  while (b > 0 && j < band_row(b, header->num_bands, h)) {
+    b--;
+  }
+  while (b + 1 < header->num_bands && j >= band_row(b + 1, header->num_bands, h)) {
+    b++;
+  }
+  return b;
+}
+
+bool gen::SlimeMoldBandProcess::wait() {
+  auto& barrier = header->barrier;
+  const uint32_t generation = barrier.generation.load(std::memory_order_acquire);
+  if (barrier.arrived.fetch_add(1, std::memory_order_acq_rel) + 1 == barrier.count) {
+    barrier.arrived.store(0, std::memory_order_relaxed);
+    barrier.generation.fetch_add(1, std::memory_order_release);
+  } else {
+    while (barrier.generation.load(std::memory_order_acquire) == generation) {
+      if (header->aborted.load(std::memory_order_acquire)) {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+  }
+  return !header->aborted.load(std::memory_order_acquire);
+}
+
+/*
+ * Leaving particles are packed into `leaving`, their holes filled from the end of the arrays.
+ * Each round, every band posts as many records as its outbox holds, then takes the records
+ * addressed to it from every outbox in band order; rounds repeat until no band has records left.
+ */
+bool gen::SlimeMoldBandProcess::migrate_particles() {
+  const int record_size = header->record_size;
+  num_leaving = 0;
+  int count = particles.size();
+  for (int i = 0; i < count;) {
+    const int dst = band_of(particles.position_y[i]);
+    if (dst == rank) {
+      i++;
+      continue;
+    }
+    leaving.resize(size_t(num_leaving + 1) * record_size);
+    unsigned char* rec = leaving.data() + size_t(num_leaving++) * record_size;
+    std::memcpy(rec, &dst, sizeof(int));
+    pack_particle(particles, i, rec + sizeof(int));
+    copy_particle(particles, count - 1, particles, i);
+    count--;
+  }
+  particles.num_particles = count;
+
+  for (int sent = 0;;) {
+    unsigned char* own = slot(rank);
+    auto* own_header = reinterpret_cast<BandSlotHeader*>(own);
+    const int n = std::min(header->outbox_capacity, num_leaving - sent);
+    std::memcpy(
+      own + slot_outbox_offset(header->edge_size), leaving.data() + size_t(sent) * record_size,
+      size_t(n) * record_size);
+    sent += n;
+    own_header->outbox_count = n;
+    own_header->more = sent < num_leaving;
+    if (!wait()) {
+      return false;
+    }
+
+    bool more{};
+    for (int b = 0; b < header->num_bands; b++) {
+      const unsigned char* s = slot(b);
+      const auto* slot_header = reinterpret_cast<const BandSlotHeader*>(s);
+      more = more || slot_header->more;
+      if (b == rank) {
+        continue;
+      }
+      const unsigned char* outbox = s + slot_outbox_offset(header->edge_size);
+      for (int k = 0; k < slot_header->outbox_count; k++) {
+        const unsigned char* rec = outbox + size_t(k) * record_size;
+        int dst;
+        std::memcpy(&dst, rec, sizeof(int));
+        if (dst != rank) {
+          continue;
+        }
+        if (particles.size() == particle_capacity) {
+          particle_capacity = std::max(64, particle_capacity + particle_capacity / 2);
+          reserve_particles(particles, particle_capacity);
+        }
+        unpack_particle(rec + sizeof(int), particles, particles.num_particles++);
+      }
+    }
+    //  Outboxes are rewritten next round.
+    if (!wait()) {
+      return false;
+    }
+    if (!more) {
+      return true;
+    }
+  }
+}
+
+/*
+ * Bands publish their outermost rows, then copy their neighbours' into their halos; zero beyond
+ * the top and bottom of the map. Edges are only rewritten after the next step's migration, which
+ * has barriers of its own.
+ */
+template <typename T>
+bool gen::SlimeMoldBandProcess::exchange_halo() {
+  const int halo = header->halo;
+  const size_t rows_size = size_t(halo) * header->width * MapView<T>::channels;
+  const int bh = y1 - y0;
+  T* data = reinterpret_cast<T*>(map.get());
+  auto edge = [&](int band, int which) {
+    return reinterpret_cast<T*>(slot(band) + slot_edges_offset() + which * header->edge_size);
+  };
+
+  const size_t row_size = size_t(header->width) * MapView<T>::channels;
+  std::copy(data + halo * row_size, data + halo * row_size + rows_size, edge(rank, 0));
+  std::copy(data + bh * row_size, data + bh * row_size + rows_size, edge(rank, 1));
+  if (!wait()) {
+    return false;
+  }
+
+  T* top = data;
+  T* bottom = data + (halo + bh) * row_size;
+  if (rank > 0) {
+    std::copy(edge(rank - 1, 1), edge(rank - 1, 1) + rows_size, top);
+  } else {
+    std::fill(top, top + rows_size, T{});
+  }
+  if (rank + 1 < header->num_bands) {
+    std::copy(edge(rank + 1, 0), edge(rank + 1, 0) + rows_size, bottom);
+  } else {
+    std::fill(bottom, bottom + rows_size, T{});
+  }
+  return true;
+}
+
+template <typename T>
+bool gen::SlimeMoldBandProcess::step_band(UpdateSlimeMoldParticlesResult* result) {
+  const auto& config = header->config;
+  const int w = header->width;
+  const int halo = header->halo;
+  const int bh = y1 - y0;
+  *result = {};
+  const auto t0 = std::chrono::high_resolution_clock::now();
+  const MapWindowView<T> window{
+    reinterpret_cast<T*>(map.get()), w, header->height, 0, y0 - halo, w};
+
+  {
+    const auto bt0 = std::chrono::high_resolution_clock::now();
+    const DirectionInfluencingImage dir_im{};
+    //  Interleaved over the bands, so bounce streams stay apart without counting other bands.
+    kernels::update_particles<T>(
+      config, particles, window, dir_im, num_steps, uint32_t(rank), uint32_t(header->num_bands));
+    result->update_ms = float(elapsed_ms(bt0));
+  }
+
+  {
+    const auto bt0 = std::chrono::high_resolution_clock::now();
+    if (!migrate_particles()) {
+      return false;
+    }
+    kernels::deposit_particles<T>(particles, window);
+    result->deposit_ms = float(elapsed_ms(bt0));
+  }
+
+  {
+    const auto bt0 = std::chrono::high_resolution_clock::now();
+    if (!exchange_halo<T>()) {
+      return false;
+    }
+    kernels::PostStepStages stages{};
+    stages.diffuse = config.diffuse_enabled;
+    stages.filter_size = config.filter_size;
+    stages.diffuse_speed = config.diffuse_speed;
+    stages.decay = config.decay;
+    stages.average = config.average_image;
+    //  The single simulation makes its perturbation map on its first step.
+    stages.diffuse_first = num_steps == 0;
+    //  The band packs its own rows, not its halo.
+    auto* image = reinterpret_cast<uint8_t*>(header) + header->image_offset;
+    stages.rgbau8 = image + size_t(y0) * w * 4;
+    stages.pack_x0 = 0;
+    stages.pack_y0 = halo;
+    stages.pack_x1 = w;
+    stages.pack_y1 = halo + bh;
+    stages.rgbau8_stride = w;
+    kernels::post_step<T>(
+      stages, MapView<T>{reinterpret_cast<T*>(map.get()), w, bh + 2 * halo}, workspace,
+      &result->pack_ms);
+    result->post_step_ms = float(elapsed_ms(bt0));
+    result->diffuse_ms = result->post_step_ms - result->pack_ms;
+  }
+
+  num_steps++;
+  const bool ok = wait();
+  result->dt_ms = float(elapsed_ms(t0));
+  return ok;
+}
+
+bool gen::SlimeMoldBandProcess::step(UpdateSlimeMoldParticlesResult* result) {
+  switch (header->config.map_storage_type) {
+    case IntegralType::HalfFloat:
+      return step_band<Half>(result);
+    case IntegralType::UnsignedShort:
+      return step_band<Unorm16>(result);
+    default:
+      assert(header->config.map_storage_type == IntegralType::Float);
+      return step_band<float>(result);
+  }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "slime_mold.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gen {
+
+//  A POSIX shared memory segment mapped into this process; unmapped on destruction.
+class SharedMemorySegment {
+public:
+  SharedMemorySegment() = default;
+  ~SharedMemorySegment();
+
+  SharedMemorySegment(const SharedMemorySegment&) = delete;
+  SharedMemorySegment& operator=(const SharedMemorySegment&) = delete;
+
+  //  Makes a zero-filled segment named `name` ("/..."), replacing any of that name.
+  bool create(const std::string& name, size_t size);
+  bool open(const std::string& name);
+  //  Removes the name; existing mappings stay valid.
+  void unlink();
+
+  unsigned char* data() const {
+    return ptr;
+  }
+  size_t size() const {
+    return bytes;
+  }
+
+private:
+  void unmap();
+
+private:
+  std::string name;
+  unsigned char* ptr{};
+  size_t bytes{};
+};
+
+struct BandSegmentHeader;
+
+/*
+ * One horizontal band of a simulation split across processes. Each process owns rows [y0, y1)
+ * of the trail map and the particles in them, in its own memory, with `halo` rows of its
+ * neighbours above and below; the band is stepped like a full-width tile of a TiledSlimeMold.
+ * The processes share one segment, made by `init_segment`, that holds
+ *
+ *  - a barrier;
+ *  - per band, its top and bottom `halo` rows, published after deposit for the neighbours'
+ *    halos, and an outbox of particles that moved out of the band, as flat records
+ *    (`pack_particle`) tagged with their destination band;
+ *  - the RGBA8 image, each band packing its own rows.
+ *
+ * A step is update; migrate (rounds of outbox exchange until every outbox is drained); deposit;
+ * halo exchange; post-step and pack; and a barrier, after which the image is complete. Bands
+ * exchange nothing but plain bytes in the segment, so the protocol does not depend on sharing
+ * an address space. Results do not depend on how the processes are scheduled. Each process steps
+ * its band on the calling thread.
+ */
+class SlimeMoldBandProcess {
+public:
+  /*
+   * Creates and initializes segment `name` for `num_bands` processes stepping `config` on a
+   * `width` x `height` map. Fails if the segment cannot be made, or if a band would be thinner
+   * than the halo.
+   */
+  static bool init_segment(
+    SharedMemorySegment& segment, const std::string& name, const SlimeMoldConfig& config,
+    int width, int height, int num_bands);
+  //  Makes every band's `step` return false, e.g. after one of the processes failed.
+  static void abort(SharedMemorySegment& segment);
+
+  //  Joins `segment`, initialized by `init_segment`, as band `rank`.
+  SlimeMoldBandProcess(SharedMemorySegment& segment, int rank);
+
+  //  False if the run was aborted.
+  bool step(UpdateSlimeMoldParticlesResult* result);
+
+  const SlimeMoldConfig& get_config() const;
+  int width() const;
+  int height() const;
+  int num_bands() const;
+  int halo_size() const;
+  int band_y0() const {
+    return y0;
+  }
+  int band_y1() const {
+    return y1;
+  }
+  int num_particles() const {
+    return particles.size();
+  }
+  //  width x height RGBA8 pixels, in the segment; complete after every band's `step` returned.
+  const uint8_t* read_rgbau8_image_data() const;
+
+private:
+  template <typename T>
+  bool step_band(UpdateSlimeMoldParticlesResult* result);
+  template <typename T>
+  bool exchange_halo();
+  bool migrate_particles();
+  bool wait();
+  int band_of(float y) const;
+  unsigned char* slot(int band) const;
+
+private:
+  BandSegmentHeader* header;
+  int rank;
+  int y0;
+  int y1;
+  std::unique_ptr<unsigned char[]> map;  //  rows [y0 - halo, y1 + halo)
+  SlimeParticles particles;
+  int particle_capacity{};
+  //  Records of particles leaving this step: destination band, then the packed particle.
+  std::vector<unsigned char> leaving;
+  int num_leaving{};
+  SlimeMoldSimulationWorkspace workspace;
+  uint32_t num_steps{};
+};
+
+}
@@ -0,0 +1,114 @@
+#include "slime_mold_telemetry.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+using namespace gen;
+
+float stage_ms(const UpdateSlimeMoldParticlesResult& res, SimStage stage) {
+  switch (stage) {
+    case SimStage::Sort:
+      return res.sort_ms;
+    case SimStage::Update:
+      return res.update_ms;
+    case SimStage::Deposit:
+      return res.deposit_ms;
+    case SimStage::Diffuse:
+      return res.diffuse_ms;
+    case SimStage::Signal:
+      return res.signal_ms;
+    case SimStage::Perturb:
+      return res.perturb_ms;
+    case SimStage::Average:
+      return res.average_ms;
+    case SimStage::Pack:
+      return res.pack_ms;
+    case SimStage::PostStep:
+      return res.post_step_ms;
+    case SimStage::Total:
+      return res.dt_ms;
+  }
+  return 0.0f;
+}
+
+//  `vs` sorted ascending and non-empty.
+float nearest_rank(const std::vector<float>& vs, double p) {
+  const auto rank = size_t(std::ceil(p * double(vs.size())));
+  return vs[std::max(size_t(1), rank) - 1];
+}
+
+} //  anon
+
+const char* gen::to_string(SimStage stage) {
+  switch (stage) {
+    case SimStage::Sort:
+      return "sort";
+    case SimStage::Update:
+      return "update";
+    case SimStage::Deposit:
+      return "deposit";
+    case SimStage::Diffuse:
+      return "diffuse";
+    case SimStage::Signal:
+      return "signal";
+    case SimStage::Perturb:
+      return "perturb";
+    case SimStage::Average:
+      return "average";
+    case SimStage::Pack:
+      return "pack";
+    case SimStage::PostStep:
+      return "post_step";
+    case SimStage::Total:
+      return "total";
+  }
+  return "";
+}
+
+gen::SimTelemetry::SimTelemetry(int window_size) {
+  set_window_size(window_size);
+}
+
+void gen::SimTelemetry::push(const UpdateSlimeMoldParticlesResult& res) {
+  for (int i = 0; i < num_sim_stages; i++) {
+    ring[i * capacity + next] = stage_ms(res, SimStage(i));
+  }
+  next = (next + 1) % capacity;
+  count = std::min(count + 1, capacity);
+}
+
+void gen::SimTelemetry::clear() {
+  count = 0;
+  next = 0;
+}
+
+void gen::SimTelemetry::set_window_size(int window_size) {
+  capacity = std::max(1, window_size);
+  ring = std::make_unique<float[]>(size_t(capacity) * num_sim_stages);
+  clear();
+}
+
+gen::SimStageSummary gen::SimTelemetry::summarize(SimStage stage) const {
+  SimStageSummary res{};
+  res.count = count;
+  if (count == 0) {
+    return res;
+  }
+
+  const float* vs = samples(stage);
+  sorted.assign(vs, vs + count);
+  res.last = vs[(next + capacity - 1) % capacity];
+  double sum{};
+  for (float v : sorted) {
+    sum += v;
+  }
+  res.mean = float(sum / count);
+
+  std::sort(sorted.begin(), sorted.end());
+  res.p50 = nearest_rank(sorted, 0.5);
+  res.p95 = nearest_rank(sorted, 0.95);
+  res.p99 = nearest_rank(sorted, 0.99);
+  res.max = sorted.back();
+  return res;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "slime_mold.hpp"
+#include <memory>
+#include <vector>
+
+namespace gen {
+
+enum class SimStage {
+  Sort = 0,
+  Update,
+  Deposit,
+  Diffuse,
+  Signal,
+  Perturb,
+  Average,
+  Pack,
+  PostStep,  //  diffuse through pack
+  Total,
+};
+
+constexpr int num_sim_stages = int(SimStage::Total) + 1;
+
+const char* to_string(SimStage stage);
+
+//  Over the samples in the window, in ms.
+struct SimStageSummary {
+  int count;
+  float last;
+  float mean;
+  float p50;
+  float p95;
+  float p99;
+  float max;
+};
+
+/*
+ * Timings of the last `window_size` steps, per stage, for spotting which stage spikes. Each
+ * stage's samples are kept in a ring: sample `i`, oldest first, is at
+ * `samples(stage)[(offset() + i) % size()]`, which is the layout ImGui::PlotLines takes.
+ * Percentiles are nearest-rank.
+ */
+class SimTelemetry {
+public:
+  static constexpr int default_window_size = 600;
+
+public:
+  explicit SimTelemetry(int window_size = default_window_size);
+
+  void push(const UpdateSlimeMoldParticlesResult& res);
+  void clear();
+  //  Clears the window.
+  void set_window_size(int window_size);
+
+  int window_size() const {
+    return capacity;
+  }
+  int size() const {
+    return count;
+  }
+  int offset() const {
+    return count < capacity ? 0 : next;
+  }
+  const float* samples(SimStage stage) const {
+    return ring.get() + int(stage) * capacity;
+  }
+
+  SimStageSummary summarize(SimStage stage) const;
+
+private:
+  std::unique_ptr<float[]> ring;
+  int capacity{};
+  int count{};
+  int next{};
+  mutable std::vector<float> sorted;
+};
+
+}
@@ -0,0 +1,306 @@
+#include "slime_mold_tiled.hpp"
+#include "slime_mold_kernels.hpp"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+using namespace gen;
+
+//  Appends particle `i` of `src`, growing `dst` as needed.
+void push_particle(SlimeParticles& dst, int& capacity, const SlimeParticles& src, int i) {
+  if (dst.size() == capacity) {
+    capacity = std::max(64, capacity + capacity / 2);
+    reserve_particles(dst, capacity);
+  }
+  copy_particle(src, i, dst, dst.num_particles++);
+}
+
+double elapsed_ms(std::chrono::high_resolution_clock::time_point t0) {
+  return std::chrono::duration<double>(
+    std::chrono::high_resolution_clock::now() - t0).count() * 1e3;
+}
+
+template <typename T>
+T* tile_map(SlimeMoldTile& tile) {
+  return reinterpret_cast<T*>(tile.map.get());
+}
+
+template <typename T>
+const T* tile_map(const SlimeMoldTile& tile) {
+  return reinterpret_cast<const T*>(tile.map.get());
+}
+
+} //  anon
+
+/*
+ * A sensor window reaches sensor_step_size + sensor_size / 2 from its particle, plus a texel for
+ * rounding; post-step results are only correct up to the filter radius from the edge of the halo,
+ * so the halo is wider by that.
+ */
+int gen::tile_halo_width(
+  const SlimeMoldConfig& config, const SlimeParticles& parts, int width, int height) {
+  //
+  float reach{};
+  for (int i = 0; i < parts.size(); i++) {
+    reach = std::max(reach, parts.sensor_step_size[i] + 0.5f * parts.sensor_size[i]);
+  }
+  const int sense = int(std::ceil(reach * float(std::max(width, height)))) + 1;
+  const int filter = config.diffuse_enabled && config.filter_size > 0 ?
+    config.filter_size / 2 + 1 : 0;
+  return sense + filter;
+}
+
+gen::TiledSlimeMold::TiledSlimeMold(
+  const SlimeMoldConfig& config, int width, int height, int tile_size) :
+  config{config}, map_width{width}, map_height{height} {
+  //
+  auto particles = make_slime_mold_particles(config);
+  halo = tile_halo_width(config, particles, width, height);
+  tile_dim = tile_size > 0 ? tile_size : std::max(256, 8 * halo);
+  tiles_x = (width + tile_dim - 1) / tile_dim;
+  tiles_y = (height + tile_dim - 1) / tile_dim;
+
+  tiles.resize(tiles_x * tiles_y);
+  for (int ty = 0; ty < tiles_y; ty++) {
+    for (int tx = 0; tx < tiles_x; tx++) {
+      auto& tile = tiles[ty * tiles_x + tx];
+      tile.x0 = tx * tile_dim;
+      tile.y0 = ty * tile_dim;
+      tile.x1 = std::min(width, tile.x0 + tile_dim);
+      tile.y1 = std::min(height, tile.y0 + tile_dim);
+      tile.map = make_slime_mold_map_data(
+        padded_width(tile), padded_height(tile), config.map_storage_type);
+      tile.particle_capacity = 0;
+      tile.outbox_capacity = 0;
+    }
+  }
+
+  for (int i = 0; i < particles.size(); i++) {
+    auto& tile = tiles[tile_of(particles.position_x[i], particles.position_y[i])];
+    push_particle(tile.particles, tile.particle_capacity, particles, i);
+  }
+
+  rgbau8 = make_rgbau8_slime_mold_texture_data(width, height);
+  incoming_offsets.resize(tiles.size() + 1);
+  first_particles.resize(tiles.size());
+  pool.set_num_threads(config.num_threads);
+}
+
+int gen::TiledSlimeMold::num_particles() const {
+  int n{};
+  for (auto& tile : tiles) {
+    n += tile.particles.size();
+  }
+  return n;
+}
+
+//  Same texel as `deposit` picks, so a particle always deposits into its own tile.
+int gen::TiledSlimeMold::tile_of(float x, float y) const {
+  const int i = std::clamp(int(std::floor(x * float(map_width))), 0, map_width - 1);
+  const int j = std::clamp(int(std::floor(y * float(map_height))), 0, map_height - 1);
+  return (j / tile_dim) * tiles_x + i / tile_dim;
+}
+
+int gen::TiledSlimeMold::padded_width(const SlimeMoldTile& tile) const {
+  return tile.x1 - tile.x0 + 2 * halo;
+}
+
+int gen::TiledSlimeMold::padded_height(const SlimeMoldTile& tile) const {
+  return tile.y1 - tile.y0 + 2 * halo;
+}
+
+/*
+ * Each tile swaps its leaving particles out to its outbox, filling the holes from the end. The
+ * outboxes are then bucketed by destination, and each tile appends its arrivals in order of
+ * source tile, so the result does not depend on the number of threads.
+ */
+void gen::TiledSlimeMold::migrate_particles() {
+  const int n = num_tiles();
+  pool.parallel_for(n, [&](int t) {
+    auto& tile = tiles[t];
+    auto& parts = tile.particles;
+    tile.outbox.num_particles = 0;
+    tile.outbox_tiles.clear();
+    int count = parts.size();
+    for (int i = 0; i < count;) {
+      const int dst = tile_of(parts.position_x[i], parts.position_y[i]);
+      if (dst == t) {
+        i++;
+        continue;
+      }
+      push_particle(tile.outbox, tile.outbox_capacity, parts, i);
+      tile.outbox_tiles.push_back(dst);
+      copy_particle(parts, count - 1, parts, i);
+      count--;
+    }
+    parts.num_particles = count;
+  });
+
+  std::fill(incoming_offsets.begin(), incoming_offsets.end(), 0);
+  for (auto& tile : tiles) {
+    for (int dst : tile.outbox_tiles) {
+      incoming_offsets[dst + 1]++;
+    }
+  }
+  for (int t = 0; t < n; t++) {
+    incoming_offsets[t + 1] += incoming_offsets[t];
+  }
+  incoming.resize(incoming_offsets[n]);
+  std::vector<int> next(incoming_offsets.begin(), incoming_offsets.end() - 1);
+  for (int t = 0; t < n; t++) {
+    const auto& dsts = tiles[t].outbox_tiles;
+    for (int k = 0; k < int(dsts.size()); k++) {
+      incoming[next[dsts[k]]++] = {t, k};
+    }
+  }
+
+  pool.parallel_for(n, [&](int t) {
+    auto& tile = tiles[t];
+    for (int k = incoming_offsets[t]; k < incoming_offsets[t + 1]; k++) {
+      const auto [src, i] = incoming[k];
+      push_particle(tile.particles, tile.particle_capacity, tiles[src].outbox, i);
+    }
+  });
+}
+
+//  Tiles only write their own halo and only read other tiles' texels, so they can run at once.
+template <typename T>
+void gen::TiledSlimeMold::exchange_halo(int t) {
+  constexpr int nc = MapView<T>::channels;
+  auto& tile = tiles[t];
+  const int pw = padded_width(tile);
+
+  //  Texels [gx0, gx1) of map row gy into `dst`, zero outside the map.
+  auto copy_run = [&](int gy, int gx0, int gx1, T* dst) {
+    if (gy < 0 || gy >= map_height) {
+      std::fill(dst, dst + (gx1 - gx0) * nc, T{});
+      return;
+    }
+    for (int gx = gx0; gx < gx1;) {
+      if (gx < 0 || gx >= map_width) {
+        const int end = gx < 0 ? std::min(gx1, 0) : gx1;
+        dst = std::fill_n(dst, (end - gx) * nc, T{});
+        gx = end;
+        continue;
+      }
+      const auto& src = tiles[(gy / tile_dim) * tiles_x + gx / tile_dim];
+      const int end = std::min(gx1, src.x1);
+      const T* s = tile_map<T>(src) +
+        ((gy - src.y0 + halo) * padded_width(src) + (gx - src.x0 + halo)) * nc;
+      dst = std::copy(s, s + (end - gx) * nc, dst);
+      gx = end;
+    }
+  };
+
+  T* map = tile_map<T>(tile);
+  for (int py = 0; py < padded_height(tile); py++) {
+    const int gy = tile.y0 - halo + py;
+    T* row = map + py * pw * nc;
+    if (gy >= tile.y0 && gy < tile.y1) {
+      copy_run(gy, tile.x0 - halo, tile.x0, row);
+      copy_run(gy, tile.x1, tile.x1 + halo, row + (pw - halo) * nc);
+    } else {
+      copy_run(gy, tile.x0 - halo, tile.x1 + halo, row);
+    }
+  }
+}
+
+template <typename T>
+UpdateSlimeMoldParticlesResult gen::TiledSlimeMold::step_tiles() {
+  UpdateSlimeMoldParticlesResult result{};
+  const auto t0 = std::chrono::high_resolution_clock::now();
+  const int n = num_tiles();
+  auto window = [&](SlimeMoldTile& tile) {
+    return MapWindowView<T>{
+      tile_map<T>(tile), map_width, map_height, tile.x0 - halo, tile.y0 - halo,
+      padded_width(tile)};
+  };
+
+  {
+    const auto bt0 = std::chrono::high_resolution_clock::now();
+    const DirectionInfluencingImage dir_im{};
+    //  Particles are numbered through the tiles in order, which keeps bounce streams apart.
+    uint32_t num_before{};
+    for (int t = 0; t < n; t++) {
+      first_particles[t] = num_before;
+      num_before += uint32_t(tiles[t].particles.size());
+    }
+    pool.parallel_for(n, [&](int t) {
+      auto& tile = tiles[t];
+      kernels::update_particles<T>(
+        config, tile.particles, window(tile), dir_im, num_steps, first_particles[t], 1);
+    });
+    result.update_ms = float(elapsed_ms(bt0));
+  }
+
+  {
+    const auto bt0 = std::chrono::high_resolution_clock::now();
+    migrate_particles();
+    pool.parallel_for(n, [&](int t) {
+      auto& tile = tiles[t];
+      kernels::deposit_particles<T>(tile.particles, window(tile));
+    });
+    result.deposit_ms = float(elapsed_ms(bt0));
+  }
+
+  {
+    const auto bt0 = std::chrono::high_resolution_clock::now();
+    pool.parallel_for(n, [&](int t) {
+      exchange_halo<T>(t);
+    });
+
+    kernels::PostStepStages stages{};
+    stages.diffuse = config.diffuse_enabled;
+    stages.filter_size = config.filter_size;
+    stages.diffuse_speed = config.diffuse_speed;
+    stages.decay = config.decay;
+    stages.average = config.average_image;
+    //  The single simulation makes its perturbation map on its first step.
+    stages.diffuse_first = num_steps == 0;
+    std::vector<float> pack_ms(n);
+    pool.parallel_for(n, [&](int t) {
+      //  Each tile packs its own texels, not its halo.
+      auto& tile = tiles[t];
+      auto tile_stages = stages;
+      tile_stages.rgbau8 = rgbau8.get() + (tile.y0 * map_width + tile.x0) * 4;
+      tile_stages.pack_x0 = halo;
+      tile_stages.pack_y0 = halo;
+      tile_stages.pack_x1 = halo + tile.x1 - tile.x0;
+      tile_stages.pack_y1 = halo + tile.y1 - tile.y0;
+      tile_stages.rgbau8_stride = map_width;
+      kernels::post_step<T>(
+        tile_stages, MapView<T>{tile_map<T>(tile), padded_width(tile), padded_height(tile)},
+        tile.workspace, &pack_ms[t]);
+    });
+
+    //  Tiles pack in parallel; share the pass out by the fraction of thread time spent packing.
+    result.post_step_ms = float(elapsed_ms(bt0));
+    double pack_total{};
+    for (double ms : pack_ms) {
+      pack_total += ms;
+    }
+    const double busy_ms = result.post_step_ms * pool.num_threads();
+    const double pack_frac = busy_ms > 0.0 ? std::min(1.0, pack_total / busy_ms) : 0.0;
+    result.pack_ms = float(result.post_step_ms * pack_frac);
+    result.diffuse_ms = result.post_step_ms - result.pack_ms;
+  }
+
+  num_steps++;
+  result.dt_ms = float(elapsed_ms(t0));
+  return result;
+}
+
+UpdateSlimeMoldParticlesResult gen::TiledSlimeMold::step() {
+  switch (config.map_storage_type) {
+    case IntegralType::HalfFloat:
+      return step_tiles<Half>();
+    case IntegralType::UnsignedShort:
+      return step_tiles<Unorm16>();
+    default:
+      assert(config.map_storage_type == IntegralType::Float);
+      return step_tiles<float>();
+  }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "slime_mold.hpp"
+#include "thread_pool.hpp"
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace gen {
+
+//  One tile of a TiledSlimeMold.
+struct SlimeMoldTile {
+  //  Texels [x0, x1) x [y0, y1) of the map, and the particles inside them.
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+  //  The tile's texels with a halo of neighbouring texels around them, `halo` wide on each side;
+  //  elements are of the map storage type.
+  std::unique_ptr<unsigned char[]> map;
+  SlimeParticles particles;
+  int particle_capacity;
+  //  Particles that moved out of the tile this step, and the tile each moved into.
+  SlimeParticles outbox;
+  int outbox_capacity;
+  std::vector<int> outbox_tiles;
+  SlimeMoldSimulationWorkspace workspace;
+};
+
+//  Halo, in texels, that a tile of a `width` x `height` map needs for `parts` to sense within it
+//  and for one post-step to leave it valid for the next step's sensing.
+int tile_halo_width(
+  const SlimeMoldConfig& config, const SlimeParticles& parts, int width, int height);
+
+/*
+ * Steps one large simulation as a grid of tiles, so that each thread works within one tile's
+ * part of the map at a time. Each tile owns a rectangle of the trail map and the particles in
+ * it, plus a halo of its neighbours' texels as wide as the farthest sensor reach and the filter
+ * radius together. A step is
+ *
+ *  - update: each tile's particles sense and move, reading only the tile and its halo;
+ *  - migrate: particles that left their tile move to the tile they are now in;
+ *  - deposit: each tile's particles deposit into the tile;
+ *  - exchange: each tile copies its halo from its neighbours, zero beyond the map's edges;
+ *  - post-step: each tile diffuses and decays its texels and halo, and packs its texels into
+ *    the RGBA8 image.
+ *
+ * Tiles run in parallel in every phase. Diffusing the halo along with the tile leaves it valid
+ * for sensing in the next step, so halos are exchanged once per step.
+ *
+ * Particles and the map follow the same rules as in `update_slime_mold_particles`, but
+ * summed-area sensing, spatial sorting, the signal and perturbation maps and the direction
+ * influencing image are not supported, and bounce headings are keyed by a particle's place in
+ * the tiles taken in order rather than its place in the whole set. A run is reproducible from
+ * its config on any number of threads.
+ */
+class TiledSlimeMold {
+public:
+  //  Tiles are `tile_size` texels square, less at the right and bottom edges; <= 0 picks a
+  //  size several times the halo. The config's thread count sizes the pool.
+  TiledSlimeMold(const SlimeMoldConfig& config, int width, int height, int tile_size = 0);
+
+  UpdateSlimeMoldParticlesResult step();
+
+  const SlimeMoldConfig& get_config() const {
+    return config;
+  }
+  int width() const {
+    return map_width;
+  }
+  int height() const {
+    return map_height;
+  }
+  int tile_size() const {
+    return tile_dim;
+  }
+  int halo_size() const {
+    return halo;
+  }
+  int num_tiles() const {
+    return int(tiles.size());
+  }
+  const SlimeMoldTile& tile(int i) const {
+    return tiles[i];
+  }
+  int num_particles() const;
+  int num_threads() const {
+    return pool.num_threads();
+  }
+  //  width x height RGBA8 pixels, packed at the end of each step.
+  const uint8_t* read_rgbau8_image_data() const {
+    return rgbau8.get();
+  }
+
+private:
+  template <typename T>
+  UpdateSlimeMoldParticlesResult step_tiles();
+  template <typename T>
+  void exchange_halo(int t);
+  void migrate_particles();
+  int tile_of(float x, float y) const;
+  int padded_width(const SlimeMoldTile& tile) const;
+  int padded_height(const SlimeMoldTile& tile) const;
+
+private:
+  SlimeMoldConfig config;
+  int map_width;
+  int map_height;
+  int tile_dim;
+  int tiles_x;
+  int tiles_y;
+  int halo;
+  uint32_t num_steps{};
+  std::vector<SlimeMoldTile> tiles;
+  std::unique_ptr<uint8_t[]> rgbau8;
+  //  Outbox entries by destination tile, as (source tile, index) pairs.
+  std::vector<int> incoming_offsets;
+  std::vector<std::pair<int, int>> incoming;
+  std::vector<uint32_t> first_particles;  //  by tile, numbering particles through the tiles
+  ThreadPool pool;
+};
+
+}
@@ -0,0 +1,506 @@
+#include "slime_mold.hpp"
+#include "slime_mold_ensemble.hpp"
+#include "image_manip.hpp"
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*
+ * Runs a parameter sweep headlessly. Points are either the grid of every combination of the
+ * given values, or a random sample from the given ranges. Each point runs for N steps; its summary
+ * metrics and final frame are cached in a directory keyed by a hash of everything that determines
+ * the run, so re-running a sweep only simulates the points it has not seen. Uncached points are
+ * stepped together as a SlimeMoldEnsemble, and a CSV of every point is written at the end.
+ */
+
+namespace {
+
+using namespace gen;
+
+//  Bump when the simulation or the metrics change in a way that invalidates cached results.
+constexpr int cache_version = 1;
+
+//  Values that particles otherwise take from `make_slime_mold_particles`.
+struct ParticleOverrides {
+  std::optional<float> sensor_size;
+  std::optional<float> sensor_step_size;
+  std::optional<float> deposit;
+};
+
+struct SweepPoint {
+  SlimeMoldConfig config;
+  ParticleOverrides particles;
+  std::vector<double> values;  //  one per swept parameter
+};
+
+struct ParamDesc {
+  const char* name;
+  bool integral;
+  void (*apply)(SweepPoint& point, double v);
+};
+
+const ParamDesc param_descs[] = {
+  {"decay", false, [](SweepPoint& p, double v) { p.config.decay = float(v); }},
+  {"diffuse_speed", false, [](SweepPoint& p, double v) { p.config.diffuse_speed = float(v); }},
+  {"filter_size", true, [](SweepPoint& p, double v) { p.config.filter_size = int(v); }},
+  {"time_scale", false, [](SweepPoint& p, double v) { p.config.time_scale = float(v); }},
+  {"speed_power", true, [](SweepPoint& p, double v) { p.config.scale_speed_power = int(v); }},
+  {"turn_speed_power", true, [](SweepPoint& p, double v) { p.config.turn_speed_power = int(v); }},
+  {"only_right_turns", true, [](SweepPoint& p, double v) { p.config.only_right_turns = v != 0.0; }},
+  {"sensor_size", false, [](SweepPoint& p, double v) { p.particles.sensor_size = float(v); }},
+  {"sensor_step", false, [](SweepPoint& p, double v) { p.particles.sensor_step_size = float(v); }},
+  {"deposit", false, [](SweepPoint& p, double v) { p.particles.deposit = float(v); }},
+};
+
+//  "name=a,b,c" lists values; "name=lo:hi" is a range, split into `levels` values on a grid or
+//  drawn from uniformly when sampling.
+struct SweepParam {
+  const ParamDesc* desc;
+  std::vector<double> values;
+  bool range;
+};
+
+struct Options {
+  SlimeMoldConfig config;
+  std::vector<SweepParam> params;
+  int steps{600};
+  int texture_width{DEFAULT_TEXTURE_SIZE};
+  int texture_height{DEFAULT_TEXTURE_SIZE};
+  int samples{};  //  > 0: random sample of this many points instead of the grid
+  uint64_t sample_seed{1};
+  int levels{5};
+  int batch_size{64};
+  std::string cache_dir{"sweep_cache"};
+  std::string out_path{"sweep.csv"};
+};
+
+struct Metrics {
+  float mean[3];
+  float coverage;  //  fraction of pixels with any channel above 0.1
+  float edge_density;  //  mean absolute luminance gradient
+  float ms_per_step;
+};
+
+void print_usage(const char* exe) {
+  std::fprintf(
+    stderr,
+    "usage: %s --param NAME=VALUES [--param ...] [options]\n"
+    "  --param NAME=a,b,c    sweep NAME over these values\n"
+    "  --param NAME=lo:hi    sweep NAME over a range (see --levels and --samples)\n"
+    "      NAME: decay, diffuse_speed, filter_size, time_scale, speed_power, turn_speed_power,\n"
+    "            only_right_turns, sensor_size, sensor_step, deposit\n"
+    "  --samples N           N random points instead of the full grid\n"
+    "  --sample-seed N       seed for --samples (1)\n"
+    "  --levels N            grid values per range (5)\n"
+    "  --steps N             steps per point (600)\n"
+    "  --particles N         particles per simulation\n"
+    "  --size W[xH]          map size (%d)\n"
+    "  --seed N              simulation seed for every point (0)\n"
+    "  --threads N           worker threads; <= 0: one per hardware thread\n"
+    "  --batch N             points simulated at once (64)\n"
+    "  --cache DIR           result cache (sweep_cache)\n"
+    "  --out PATH            CSV of every point (sweep.csv)\n",
+    exe, DEFAULT_TEXTURE_SIZE);
+}
+
+bool parse_param(const char* s, SweepParam* param) {
+  const char* eq = std::strchr(s, '=');
+  if (!eq) {
+    return false;
+  }
+  const std::string name(s, eq);
+  param->desc = nullptr;
+  for (auto& desc : param_descs) {
+    if (name == desc.name) {
+      param->desc = &desc;
+    }
+  }
+  if (!param->desc) {
+    return false;
+  }
+
+  param->values.clear();
+  const char* p = eq + 1;
+  while (*p) {
+    char* end{};
+    param->values.push_back(std::strtod(p, &end));
+    if (end == p) {
+      return false;
+    }
+    p = end;
+    if (*p == ',' || *p == ':') {
+      param->range = *p == ':';
+      p++;
+    } else if (*p) {
+      return false;
+    }
+  }
+  return param->range ? param->values.size() == 2 : !param->values.empty();
+}
+
+bool parse_size(const char* s, int* w, int* h) {
+  char* end{};
+  *w = int(std::strtol(s, &end, 10));
+  *h = *w;
+  if (*end == 'x') {
+    *h = int(std::strtol(end + 1, &end, 10));
+  }
+  return *end == '\0' && *w > 0 && *h > 0;
+}
+
+bool parse_options(int argc, char** argv, Options* opts) {
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* v = i + 1 < argc ? argv[++i] : nullptr;
+    bool ok = v != nullptr;
+    if (!ok) {
+      //  fall through to the error
+    } else if (std::strcmp(arg, "--param") == 0) {
+      SweepParam param{};
+      ok = parse_param(v, &param);
+      opts->params.push_back(param);
+    } else if (std::strcmp(arg, "--samples") == 0) {
+      opts->samples = std::atoi(v);
+    } else if (std::strcmp(arg, "--sample-seed") == 0) {
+      opts->sample_seed = std::strtoull(v, nullptr, 10);
+    } else if (std::strcmp(arg, "--levels") == 0) {
+      opts->levels = std::atoi(v);
+      ok = opts->levels > 0;
+    } else if (std::strcmp(arg, "--steps") == 0) {
+      opts->steps = std::atoi(v);
+    } else if (std::strcmp(arg, "--particles") == 0) {
+      opts->config.num_particles = std::atoi(v);
+    } else if (std::strcmp(arg, "--size") == 0) {
+      ok = parse_size(v, &opts->texture_width, &opts->texture_height);
+    } else if (std::strcmp(arg, "--seed") == 0) {
+      opts->config.seed = std::strtoull(v, nullptr, 10);
+    } else if (std::strcmp(arg, "--threads") == 0) {
+      opts->config.num_threads = std::atoi(v);
+    } else if (std::strcmp(arg, "--batch") == 0) {
+      opts->batch_size = std::atoi(v);
+      ok = opts->batch_size > 0;
+    } else if (std::strcmp(arg, "--cache") == 0) {
+      opts->cache_dir = v;
+    } else if (std::strcmp(arg, "--out") == 0) {
+      opts->out_path = v;
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::fprintf(stderr, "bad or incomplete option: %s\n", arg);
+      return false;
+    }
+  }
+  return !opts->params.empty() && opts->steps > 0 && opts->config.num_particles > 0;
+}
+
+double round_if_integral(const ParamDesc& desc, double v) {
+  return desc.integral ? std::round(v) : v;
+}
+
+std::vector<SweepPoint> make_points(const Options& opts) {
+  std::vector<std::vector<double>> axes;
+  for (auto& param : opts.params) {
+    std::vector<double> axis = param.values;
+    if (param.range && opts.samples <= 0) {
+      axis.clear();
+      const double lo = param.values[0];
+      const double hi = param.values[1];
+      for (int i = 0; i < opts.levels; i++) {
+        const double t = opts.levels > 1 ? double(i) / double(opts.levels - 1) : 0.5;
+        axis.push_back(round_if_integral(*param.desc, lo + (hi - lo) * t));
+      }
+      axis.erase(std::unique(axis.begin(), axis.end()), axis.end());
+    }
+    axes.push_back(std::move(axis));
+  }
+
+  std::vector<std::vector<double>> rows;
+  if (opts.samples > 0) {
+    for (int i = 0; i < opts.samples; i++) {
+      CounterRng rng(opts.sample_seed, 0, uint32_t(i));
+      std::vector<double> row;
+      for (size_t k = 0; k < opts.params.size(); k++) {
+        const auto& param = opts.params[k];
+        if (param.range) {
+          const double t = rng.urandf();
+          const double v = param.values[0] + (param.values[1] - param.values[0]) * t;
+          row.push_back(round_if_integral(*param.desc, v));
+        } else {
+          row.push_back(axes[k][rng.uniform_int(int(axes[k].size()))]);
+        }
+      }
+      rows.push_back(std::move(row));
+    }
+  } else {
+    rows.emplace_back();
+    for (auto& axis : axes) {
+      std::vector<std::vector<double>> next;
+      for (auto& row : rows) {
+        for (double v : axis) {
+          next.push_back(row);
+          next.back().push_back(v);
+        }
+      }
+      rows = std::move(next);
+    }
+  }
+
+  std::vector<SweepPoint> res;
+  for (auto& row : rows) {
+    SweepPoint point{};
+    point.config = opts.config;
+    for (size_t k = 0; k < row.size(); k++) {
+      opts.params[k].desc->apply(point, row[k]);
+    }
+    point.values = std::move(row);
+    res.push_back(std::move(point));
+  }
+  return res;
+}
+
+//  Every input that determines a run's result. Floats are written exactly, in hex.
+std::string describe_run(const Options& opts, const SweepPoint& point) {
+  const auto& c = point.config;
+  char buff[1024];
+  std::snprintf(
+    buff, sizeof(buff),
+    "v%d size=%dx%d steps=%d particles=%d seed=%" PRIu64 " storage=%d "
+    "filter_size=%d decay=%a diffuse_speed=%a diffuse=%d time_scale=%a simd=%d sat=%d sort=%d "
+    "perturb=%d,%d,%d,%d,%d signal=%d average=%d circular=%d "
+    "speed_power=%d turn_speed_power=%d right_only=%d dir_scale=%a",
+    cache_version, opts.texture_width, opts.texture_height, opts.steps, c.num_particles, c.seed,
+    int(c.map_storage_type), c.filter_size, c.decay, c.diffuse_speed, int(c.diffuse_enabled),
+    c.time_scale, int(c.simd_update_enabled), int(c.summed_area_sensing),
+    c.spatial_sort_interval, int(c.allow_perturb_event), c.num_perturb_iters, c.perturb_interval,
+    c.perturb_event_type, c.num_perturb_circles, int(c.allow_signal_influence),
+    int(c.average_image), int(c.circular_world), c.scale_speed_power, c.turn_speed_power,
+    int(c.only_right_turns), c.direction_influencing_image_scale);
+  std::string res = buff;
+  auto add_override = [&](const char* name, const std::optional<float>& v) {
+    if (v) {
+      std::snprintf(buff, sizeof(buff), " %s=%a", name, v.value());
+      res += buff;
+    }
+  };
+  add_override("sensor_size", point.particles.sensor_size);
+  add_override("sensor_step", point.particles.sensor_step_size);
+  add_override("deposit", point.particles.deposit);
+  return res;
+}
+
+uint64_t fnv1a(const std::string& s) {
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : s) {
+    h = (h ^ c) * 1099511628211ull;
+  }
+  return h;
+}
+
+std::string cache_path(const Options& opts, uint64_t key, const char* ext) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "/%016" PRIx64 "%s", key, ext);
+  return opts.cache_dir + name;
+}
+
+void apply_overrides(const ParticleOverrides& overrides, SlimeParticles& parts) {
+  for (int i = 0; i < parts.size(); i++) {
+    if (overrides.sensor_size) {
+      parts.sensor_size[i] = overrides.sensor_size.value();
+    }
+    if (overrides.sensor_step_size) {
+      parts.sensor_step_size[i] = overrides.sensor_step_size.value();
+    }
+    if (overrides.deposit) {
+      parts.deposit[i] = overrides.deposit.value();
+    }
+  }
+}
+
+Metrics compute_metrics(const uint8_t* rgba, int w, int h) {
+  Metrics res{};
+  double sum[3]{};
+  double covered{};
+  double grad{};
+  auto lum = [&](int x, int y) {
+    const uint8_t* p = rgba + (y * w + x) * 4;
+    return (double(p[0]) + double(p[1]) + double(p[2])) / (3.0 * 255.0);
+  };
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      const uint8_t* p = rgba + (y * w + x) * 4;
+      for (int k = 0; k < 3; k++) {
+        sum[k] += p[k] / 255.0;
+      }
+      covered += std::max({p[0], p[1], p[2]}) > 25 ? 1.0 : 0.0;
+      const double l = lum(x, y);
+      grad += std::abs(lum(std::min(x + 1, w - 1), y) - l) +
+              std::abs(lum(x, std::min(y + 1, h - 1)) - l);
+    }
+  }
+  const double n = double(w) * double(h);
+  for (int k = 0; k < 3; k++) {
+    res.mean[k] = float(sum[k] / n);
+  }
+  res.coverage = float(covered / n);
+  res.edge_density = float(grad / n);
+  return res;
+}
+
+//  Written to a temporary file and renamed, so an interrupted sweep never leaves a partial entry.
+bool write_cache_entry(
+  const Options& opts, uint64_t key, const std::string& desc, const Metrics& m) {
+  //
+  const auto path = cache_path(opts, key, ".json");
+  const auto tmp_path = path + ".tmp";
+  FILE* f = std::fopen(tmp_path.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+  std::fprintf(
+    f,
+    "{\"mean\": [%.9g, %.9g, %.9g], \"coverage\": %.9g, \"edge_density\": %.9g, "
+    "\"ms_per_step\": %.9g, \"run\": \"%s\"}\n",
+    m.mean[0], m.mean[1], m.mean[2], m.coverage, m.edge_density, m.ms_per_step, desc.c_str());
+  if (std::fclose(f) != 0) {
+    return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  return !ec;
+}
+
+std::optional<Metrics> read_cache_entry(const Options& opts, uint64_t key) {
+  FILE* f = std::fopen(cache_path(opts, key, ".json").c_str(), "r");
+  if (!f) {
+    return std::nullopt;
+  }
+  Metrics m{};
+  const int n = std::fscanf(
+    f,
+    "{\"mean\": [%g, %g, %g], \"coverage\": %g, \"edge_density\": %g, \"ms_per_step\": %g",
+    &m.mean[0], &m.mean[1], &m.mean[2], &m.coverage, &m.edge_density, &m.ms_per_step);
+  std::fclose(f);
+  return n == 6 ? std::optional<Metrics>{m} : std::nullopt;
+}
+
+bool write_frame(const std::string& path, const uint8_t* rgba, int w, int h) {
+  auto rgb = std::make_unique<uint8_t[]>(w * h * 3);
+  for (int i = 0; i < w * h; i++) {
+    std::memcpy(rgb.get() + i * 3, rgba + i * 4, 3);
+  }
+  return im::write_image(path.c_str(), rgb.get(), w, h, 3);
+}
+
+//  Simulates `points[todo[...]]` and caches their results.
+bool run_points(
+  const Options& opts, const std::vector<SweepPoint>& points, const std::vector<uint64_t>& keys,
+  const std::vector<std::string>& descs, const std::vector<int>& todo) {
+  //
+  SlimeMoldEnsemble ensemble{opts.config.num_threads};
+  for (size_t b = 0; b < todo.size(); b += opts.batch_size) {
+    const size_t e = std::min(todo.size(), b + size_t(opts.batch_size));
+    ensemble.clear();
+    for (size_t i = b; i < e; i++) {
+      const auto& point = points[todo[i]];
+      const int m = ensemble.add(point.config, opts.texture_width, opts.texture_height);
+      apply_overrides(point.particles, ensemble.member(m).particles);
+    }
+
+    ensemble.step(opts.steps);
+
+    for (int m = 0; m < ensemble.size(); m++) {
+      const int pi = todo[b + m];
+      const auto& tex = ensemble.member(m).texture_data;
+      const uint8_t* rgba = tex.rgbau8_texture_data.get();
+      auto metrics = compute_metrics(rgba, tex.width, tex.height);
+      metrics.ms_per_step = float(ensemble.member(m).total_ms / opts.steps);
+      if (!write_frame(cache_path(opts, keys[pi], ".png"), rgba, tex.width, tex.height) ||
+          !write_cache_entry(opts, keys[pi], descs[pi], metrics)) {
+        std::fprintf(stderr, "failed to write to %s\n", opts.cache_dir.c_str());
+        return false;
+      }
+    }
+    std::printf("simulated %d / %d new points\n", int(e), int(todo.size()));
+    std::fflush(stdout);
+  }
+  return true;
+}
+
+bool write_csv(
+  const Options& opts, const std::vector<SweepPoint>& points, const std::vector<uint64_t>& keys) {
+  //
+  FILE* f = std::fopen(opts.out_path.c_str(), "w");
+  if (!f) {
+    return false;
+  }
+  std::fprintf(f, "key");
+  for (auto& param : opts.params) {
+    std::fprintf(f, ",%s", param.desc->name);
+  }
+  std::fprintf(f, ",mean_r,mean_g,mean_b,coverage,edge_density,ms_per_step,frame\n");
+  for (size_t i = 0; i < points.size(); i++) {
+    const auto m = read_cache_entry(opts, keys[i]);
+    if (!m) {
+      continue;
+    }
+    std::fprintf(f, "%016" PRIx64, keys[i]);
+    for (double v : points[i].values) {
+      std::fprintf(f, ",%.9g", v);
+    }
+    std::fprintf(
+      f, ",%.6g,%.6g,%.6g,%.6g,%.6g,%.4g,%s\n", m->mean[0], m->mean[1], m->mean[2],
+      m->coverage, m->edge_density, m->ms_per_step, cache_path(opts, keys[i], ".png").c_str());
+  }
+  return std::fclose(f) == 0;
+}
+
+} //  anon
+
+int main(int argc, char** argv) {
+  Options opts;
+  if (!parse_options(argc, argv, &opts)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(opts.cache_dir, ec);
+  if (ec) {
+    std::fprintf(stderr, "failed to create %s\n", opts.cache_dir.c_str());
+    return 1;
+  }
+
+  const auto points = make_points(opts);
+  std::vector<uint64_t> keys;
+  std::vector<std::string> descs;
+  std::vector<int> todo;
+  for (int i = 0; i < int(points.size()); i++) {
+    descs.push_back(describe_run(opts, points[i]));
+    keys.push_back(fnv1a(descs.back()));
+    const bool seen = std::find(keys.begin(), keys.end() - 1, keys.back()) != keys.end() - 1;
+    if (!seen && !read_cache_entry(opts, keys.back())) {
+      todo.push_back(i);
+    }
+  }
+  std::printf(
+    "%d points, %d cached, %d to simulate\n",
+    int(points.size()), int(points.size() - todo.size()), int(todo.size()));
+
+  if (!run_points(opts, points, keys, descs, todo)) {
+    return 1;
+  }
+  if (!write_csv(opts, points, keys)) {
+    std::fprintf(stderr, "failed to write %s\n", opts.out_path.c_str());
+    return 1;
+  }
+  std::printf("wrote %s\n", opts.out_path.c_str());
+  return 0;
+}
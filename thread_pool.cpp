@@ -0,0 +1,121 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+
+int gen::hardware_concurrency() {
+#if SM_THREADS_ENABLED
+  return std::max(1, int(std::thread::hardware_concurrency()));
+#else
+  return 1;
+#endif
+}
+
+gen::ThreadPool::ThreadPool(int num_threads) {
+  set_num_threads(num_threads);
+}
+
+gen::ThreadPool::~ThreadPool() {
+  stop_workers();
+}
+
+int gen::ThreadPool::num_threads() const {
+  return int(workers.size()) + 1;
+}
+
+void gen::ThreadPool::set_num_threads(int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = hardware_concurrency();
+  }
+#if !SM_THREADS_ENABLED
+  num_threads = 1;
+#endif
+  if (num_threads != this->num_threads()) {
+    stop_workers();
+    start_workers(num_threads - 1);
+  }
+}
+
+void gen::ThreadPool::start_workers(int num_workers) {
+  stop = false;
+  //  Workers start from the current generation so a dispatch issued before they first run is
+  //  not missed.
+  const uint64_t start_generation = generation;
+  for (int i = 0; i < num_workers; i++) {
+    workers.emplace_back([this, start_generation]() {
+      worker_loop(start_generation);
+    });
+  }
+}
+
+void gen::ThreadPool::stop_workers() {
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    stop = true;
+  }
+  work_cv.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+}
+
+void gen::ThreadPool::run_tasks() {
+  int i;
+  while ((i = next_task.fetch_add(1)) < num_tasks) {
+    (*task)(i);
+  }
+}
+
+void gen::ThreadPool::worker_loop(uint64_t seen_generation) {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock{mutex};
+      work_cv.wait(lock, [&]() {
+        return stop || generation != seen_generation;
+      });
+      if (stop) {
+        return;
+      }
+      seen_generation = generation;
+    }
+
+    run_tasks();
+
+    {
+      std::lock_guard<std::mutex> lock{mutex};
+      if (--num_active_workers == 0) {
+        done_cv.notify_one();
+      }
+    }
+  }
+}
+
+void gen::ThreadPool::parallel_for(int n, const Task& t) {
+  if (n <= 0) {
+    return;
+  }
+
+  if (workers.empty() || n == 1) {
+    for (int i = 0; i < n; i++) {
+      t(i);
+    }
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock{mutex};
+    task = &t;
+    num_tasks = n;
+    next_task = 0;
+    num_active_workers = int(workers.size());
+    generation++;
+  }
+  work_cv.notify_all();
+
+  run_tasks();
+
+  std::unique_lock<std::mutex> lock{mutex};
+  done_cv.wait(lock, [this]() {
+    return num_active_workers == 0;
+  });
+  task = nullptr;
+}
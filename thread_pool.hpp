@@ -0,0 +1,63 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+
+#if defined(SM_IS_EMSCRIPTEN) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define SM_THREADS_ENABLED (0)
+#else
+#define SM_THREADS_ENABLED (1)
+#endif
+
+namespace gen {
+
+/*
+ * Persistent pool of worker threads. `parallel_for` hands out task indices to the workers and to
+ * the calling thread, and returns once every task has run. Without thread support, or with a
+ * single thread, tasks run serially on the caller.
+ */
+class ThreadPool {
+public:
+  using Task = std::function<void(int)>;
+
+public:
+  ThreadPool() = default;
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  //  Total number of threads that run tasks, including the calling thread. <= 0 selects the
+  //  number of hardware threads.
+  void set_num_threads(int num_threads);
+  int num_threads() const;
+
+  void parallel_for(int num_tasks, const Task& task);
+
+private:
+  void start_workers(int num_workers);
+  void stop_workers();
+  void worker_loop(uint64_t seen_generation);
+  void run_tasks();
+
+private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable work_cv;
+  std::condition_variable done_cv;
+  const Task* task{};
+  int num_tasks{};
+  std::atomic<int> next_task{};
+  int num_active_workers{};
+  uint64_t generation{};
+  bool stop{};
+};
+
+int hardware_concurrency();
+
+}
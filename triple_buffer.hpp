@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace gen {
+
+/*
+ * Lock-free triple buffer between one producer thread and one consumer thread. The producer fills
+ * `back` and publishes it; the consumer takes the newest published slot as `front`. Neither side
+ * ever waits for the other: a publish replaces a slot the consumer has not taken yet, and taking
+ * with nothing new published keeps the current front.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+  //  Producer side.
+  T& back() {
+    return slots[back_index];
+  }
+  //  Makes `back` the newest slot, and hands the producer a free slot as the new `back`; true if
+  //  the slot it replaced was never taken.
+  bool publish() {
+    const uint32_t prev = middle.exchange(back_index | fresh_bit, std::memory_order_acq_rel);
+    back_index = prev & index_mask;
+    return (prev & fresh_bit) != 0;
+  }
+  //  False once the consumer has taken the last published slot.
+  bool pending() const {
+    return (middle.load(std::memory_order_acquire) & fresh_bit) != 0;
+  }
+
+  //  Consumer side. Makes the newest published slot `front`; false if nothing was published since
+  //  the last take.
+  bool take() {
+    if (!pending()) {
+      return false;
+    }
+    const uint32_t prev = middle.exchange(front_index, std::memory_order_acq_rel);
+    front_index = prev & index_mask;
+    return true;
+  }
+  T& front() {
+    return slots[front_index];
+  }
+  const T& front() const {
+    return slots[front_index];
+  }
+
+private:
+  static constexpr uint32_t index_mask = 3u;
+  static constexpr uint32_t fresh_bit = 4u;
+
+  T slots[3]{};
+  uint32_t back_index{0};
+  uint32_t front_index{1};
+  //  Index of the slot between the two sides, and whether it holds a publish not yet taken.
+  std::atomic<uint32_t> middle{2};
+};
+
+}
@@ -5,6 +5,7 @@
 #include <webgpu/webgpu.h>
 #include <webgpu/webgpu_cpp.h>
 #include <emscripten/html5_webgpu.h>
+#include <algorithm>
 #include <cstdio>
 
 namespace {
@@ -39,6 +40,7 @@ struct {
   WGPUTexture image{};
   WGPUTextureView image_view{};
   uint32_t image_dim{};
+  bool need_full_image_write{};
   WGPUSampler image_sampler{};
   WGPUBuffer uniform_buffer{};
   Uniforms uniforms{};
@@ -226,6 +228,7 @@ void create_image(WGPUDevice device, uint32_t texture_dim) {
   globals.image_sampler = wgpuDeviceCreateSampler(device, &sampler_desc);
 
   globals.image_dim = texture_dim;
+  globals.need_full_image_write = true;
 
   //  @TODO
 //  wgpuTextureDestroy(texture);
@@ -447,7 +450,8 @@ void gfx::gui_new_frame() {
 }
 
 void gfx::begin_frame(
-  const Context& context, const void* image_data, const uint8_t* dir_image, int dir_im_dim) {
+  const Context& context, const void* image_data, const ImageRect* dirty_rects,
+  int num_dirty_rects, const uint8_t* dir_image, int dir_im_dim) {
   //
   globals.prepared = false;
 
@@ -481,29 +485,50 @@ void gfx::begin_frame(
     globals.need_remake_bind_group = false;
   }
 
-  {
-    //  image
-    WGPUImageCopyTexture dst{};
-    dst.aspect = WGPUTextureAspect_All;
-    dst.mipLevel = 0;
-    dst.texture = globals.image;
-
-    const uint32_t texture_dim = globals.image_dim;
-
-    WGPUTextureDataLayout src_layout{};
-    src_layout.bytesPerRow =
-      texture_dim * Config::bytes_per_component * Config::num_components_per_pixel;
-    src_layout.rowsPerImage = texture_dim;
-    const int tot_size = int(src_layout.bytesPerRow * src_layout.rowsPerImage);
-
-    WGPUExtent3D write_size{};
-    write_size.depthOrArrayLayers = 1;
-    write_size.width = texture_dim;
-    write_size.height = texture_dim;
-
-    auto device = (WGPUDevice) globals.wgpu_device;
-    wgpuQueueWriteTexture(
-      wgpuDeviceGetQueue(device), &dst, image_data, tot_size, &src_layout, &write_size);
+  if (image_data) {
+    //  image; only the dirty rects, unless the texture is new
+    const int texture_dim = int(globals.image_dim);
+    const uint32_t bytes_per_pixel =
+      Config::bytes_per_component * Config::num_components_per_pixel;
+    const uint32_t bytes_per_row = texture_dim * bytes_per_pixel;
+    const size_t tot_size = size_t(bytes_per_row) * texture_dim;
+    auto queue = wgpuDeviceGetQueue((WGPUDevice) globals.wgpu_device);
+
+    auto write_rect = [&](int x0, int y0, int x1, int y1) {
+      WGPUImageCopyTexture dst{};
+      dst.aspect = WGPUTextureAspect_All;
+      dst.mipLevel = 0;
+      dst.texture = globals.image;
+      dst.origin = {uint32_t(x0), uint32_t(y0), 0};
+
+      //  rows of the rect are a full image row apart in `image_data`
+      WGPUTextureDataLayout src_layout{};
+      src_layout.offset = uint64_t(y0) * bytes_per_row + uint64_t(x0) * bytes_per_pixel;
+      src_layout.bytesPerRow = bytes_per_row;
+      src_layout.rowsPerImage = uint32_t(y1 - y0);
+
+      WGPUExtent3D write_size{};
+      write_size.depthOrArrayLayers = 1;
+      write_size.width = uint32_t(x1 - x0);
+      write_size.height = uint32_t(y1 - y0);
+      wgpuQueueWriteTexture(queue, &dst, image_data, tot_size, &src_layout, &write_size);
+    };
+
+    if (globals.need_full_image_write) {
+      write_rect(0, 0, texture_dim, texture_dim);
+      globals.need_full_image_write = false;
+    } else {
+      for (int i = 0; i < num_dirty_rects; i++) {
+        const auto& r = dirty_rects[i];
+        const int x0 = std::max(0, r.x0);
+        const int y0 = std::max(0, r.y0);
+        const int x1 = std::min(texture_dim, r.x1);
+        const int y1 = std::min(texture_dim, r.y1);
+        if (x1 > x0 && y1 > y0) {
+          write_rect(x0, y0, x1, y1);
+        }
+      }
+    }
   }
   {
     //  uniform buffer